@@ -5,11 +5,232 @@
 
 #include "common.hpp"
 
+#include <hpx/algorithm.hpp>
+#include <hpx/execution.hpp>
+#include <hpx/synchronization/condition_variable.hpp>
+#include <hpx/synchronization/mutex.hpp>
+
 #include <atomic>
 #include <optional>
 #include <list>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <limits>
+#include <cstring>
+#include <new>
+#include <iterator>
+#include <functional>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
 
 namespace hitycho::atomic {
+namespace detail {
+constexpr auto mix_hash(std::uint64_t key) noexcept {
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53ULL;
+    key ^= key >> 33;
+    return key;
+}
+
+constexpr auto reverse_bits(std::uint64_t value) noexcept {
+    value = ((value >> 1) & 0x5555555555555555ULL) | ((value & 0x5555555555555555ULL) << 1);
+    value = ((value >> 2) & 0x3333333333333333ULL) | ((value & 0x3333333333333333ULL) << 2);
+    value = ((value >> 4) & 0x0f0f0f0f0f0f0f0fULL) | ((value & 0x0f0f0f0f0f0f0f0fULL) << 4);
+    value = ((value >> 8) & 0x00ff00ff00ff00ffULL) | ((value & 0x00ff00ff00ff00ffULL) << 8);
+    value = ((value >> 16) & 0x0000ffff0000ffffULL) | ((value & 0x0000ffff0000ffffULL) << 16);
+    return (value >> 32) | (value << 32);
+}
+
+constexpr auto log2_floor(std::uint64_t value) noexcept -> unsigned {
+    return 63U - unsigned(__builtin_clzll(value));
+}
+
+inline void spin_pause() noexcept {
+#if defined(__SSE2__)
+    _mm_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
+// bitmask of the bytes in a 16 byte control group equal to value
+inline auto match_group(const std::int8_t *ctrl, std::int8_t value) noexcept -> std::uint32_t {
+#if defined(__SSE2__)
+    const auto group = _mm_load_si128(reinterpret_cast<const __m128i *>(ctrl));
+    return std::uint32_t(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(value), group)));
+#else
+    std::uint32_t mask = 0;
+    for (unsigned pos = 0; pos < 16; ++pos)
+        mask |= std::uint32_t(ctrl[pos] == value) << pos;
+    return mask;
+#endif
+}
+
+// bitmask of the bytes in a 16 byte control group with the high bit set
+inline auto match_negative(const std::int8_t *ctrl) noexcept -> std::uint32_t {
+#if defined(__SSE2__)
+    return std::uint32_t(_mm_movemask_epi8(_mm_load_si128(reinterpret_cast<const __m128i *>(ctrl))));
+#else
+    std::uint32_t mask = 0;
+    for (unsigned pos = 0; pos < 16; ++pos)
+        mask |= std::uint32_t(ctrl[pos] < 0) << pos;
+    return mask;
+#endif
+}
+
+struct worker_ids_t final {
+    std::mutex lock;
+    std::vector<std::size_t> free;
+    std::size_t next{0};
+};
+
+inline auto worker_ids() -> worker_ids_t& {
+    static auto ids = new worker_ids_t(); // used at thread exit, never destroyed
+    return *ids;
+}
+
+// stable small id for the calling os (hpx worker) thread. Ids are returned
+// when a thread exits and reused by later threads, so tables indexed by id
+// stay small as threads come and go. Once the id is returned, such as from
+// a later thread_local destructor, the thread gets an id past any table.
+inline auto worker_id() noexcept -> std::size_t {
+    constexpr auto unleased = ~std::size_t(0);
+    constexpr auto released = unleased >> 1;
+    thread_local std::size_t id = unleased;
+    if (id != unleased) return id;
+
+    struct lease_t final {
+        lease_t() = default;
+        lease_t(const lease_t&) = delete;
+        auto operator=(const lease_t&) -> auto& = delete;
+
+        ~lease_t() {
+            auto& ids = worker_ids();
+            const std::lock_guard<std::mutex> lock(ids.lock);
+            try {
+                ids.free.push_back(id);
+            } catch (...) { // the id is simply not reused
+            }
+            id = released;
+        }
+    };
+
+    auto& ids = worker_ids();
+    {
+        const std::lock_guard<std::mutex> lock(ids.lock);
+        if (ids.free.empty())
+            id = ids.next++;
+        else {
+            id = ids.free.back();
+            ids.free.pop_back();
+        }
+    }
+    thread_local const lease_t lease;
+    return id;
+}
+
+// hashed wait queues shared by every waitable address, parks hpx threads
+struct alignas(cache_line) parking_t {
+    hpx::mutex lock;
+    hpx::condition_variable cond;
+    std::atomic<std::size_t> waiters{0};
+};
+
+inline auto parking(const volatile void *addr) noexcept -> parking_t& {
+    static parking_t table[64];
+    return table[mix_hash(reinterpret_cast<std::uintptr_t>(addr)) % 64];
+}
+
+template <typename Changed>
+void park(const volatile void *addr, Changed changed) {
+    for (unsigned spin = 0; spin < 16; ++spin) {
+        if (changed()) return;
+        spin_pause();
+    }
+
+    auto& slot = parking(addr);
+    slot.waiters.fetch_add(1);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    std::unique_lock<hpx::mutex> lock(slot.lock);
+    while (!changed())
+        slot.cond.wait(lock);
+    lock.unlock();
+    slot.waiters.fetch_sub(1, std::memory_order_release);
+}
+
+// addresses may share a queue, so every waiter is woken to recheck its value
+inline void unpark(const volatile void *addr) {
+    auto& slot = parking(addr);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!slot.waiters.load(std::memory_order_relaxed)) return;
+    { const std::lock_guard<hpx::mutex> lock(slot.lock); }
+    slot.cond.notify_all();
+}
+
+constexpr std::size_t huge_size = std::size_t(2) << 20;
+
+constexpr auto mapped_pages([[maybe_unused]] bool huge, [[maybe_unused]] int node) noexcept {
+#if defined(__linux__)
+    return huge || node >= 0;
+#else
+    return false;
+#endif
+}
+
+constexpr auto page_bytes(std::size_t bytes, bool huge) noexcept {
+    return huge ? (bytes + huge_size - 1) & ~(huge_size - 1) : bytes;
+}
+
+// storage for large slabs. Huge pages fall back to transparent huge pages,
+// and a numa node is a preference applied before the pages are touched, so
+// both are best effort. Otherwise this is aligned heap memory.
+inline auto map_pages(std::size_t bytes, std::size_t align, bool huge, [[maybe_unused]] int node = -1) -> void * {
+#if defined(__linux__)
+    if (mapped_pages(huge, node)) {
+        bytes = page_bytes(bytes, huge);
+        auto mem = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | (huge ? MAP_HUGETLB : 0), -1, 0);
+        if (mem == MAP_FAILED && huge) {
+            mem = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (mem != MAP_FAILED)
+                ::madvise(mem, bytes, MADV_HUGEPAGE);
+        }
+        if (mem == MAP_FAILED) throw std::bad_alloc();
+#if defined(SYS_mbind)
+        constexpr auto bits = sizeof(unsigned long) * 8;
+        unsigned long mask[1024 / bits]{};
+        if (node >= 0 && std::size_t(node) < 1024) {
+            mask[std::size_t(node) / bits] = 1UL << (std::size_t(node) % bits);
+            ::syscall(SYS_mbind, mem, bytes, 1 /* MPOL_PREFERRED */, mask, 1024 + 1, 0);
+        }
+#endif
+        return mem;
+    }
+#endif
+    return ::operator new(bytes, std::align_val_t(align > cache_line ? align : cache_line));
+}
+
+inline void unmap_pages(void *mem, std::size_t bytes, std::size_t align, bool huge, int node = -1) noexcept {
+#if defined(__linux__)
+    if (mapped_pages(huge, node)) {
+        ::munmap(mem, page_bytes(bytes, huge));
+        return;
+    }
+#endif
+    ::operator delete(mem, std::align_val_t(align > cache_line ? align : cache_line));
+}
+} // namespace detail
+
 template <typename T = unsigned>
 class sequence_t final {
 public:
@@ -48,426 +269,2713 @@ public:
         return seq_.is_lock_free();
     }
 
+    void wait(T old) const {
+        detail::park(&seq_, [this, old] { return seq_.load(std::memory_order_acquire) != old; });
+    }
+
+    void notify_one() const {
+        detail::unpark(&seq_);
+    }
+
+    void notify_all() const {
+        detail::unpark(&seq_);
+    }
+
+private:
+    static_assert(std::is_unsigned_v<T>, "T must be unsigned numeric");
+
+    mutable std::atomic<T> seq_{0};
+};
+
+// Each worker leases a block of ids from the shared counter and hands them
+// out locally. Shards are owned by one os thread, so an id is drawn without
+// any atomic operation. Ids are unique and increase per worker; the
+// Monotonic variant draws every id from the shared counter for global order.
+template <typename T = std::uint64_t, std::size_t B = 4096, bool Monotonic = false, std::size_t S = 64>
+class sharded_sequence_t final {
+public:
+    sharded_sequence_t() noexcept = default;
+    explicit sharded_sequence_t(T initial) noexcept : seq_(initial) {};
+
+    sharded_sequence_t(const sharded_sequence_t&) = delete;
+    auto operator=(const sharded_sequence_t&) -> auto& = delete;
+
+    auto operator*() noexcept {
+        return next();
+    }
+
+    auto next() noexcept -> T {
+        if constexpr (!Monotonic) {
+            const auto id = detail::worker_id();
+            if (id < S) {
+                auto& shard = shards_[id];
+                if (shard.next == shard.limit) {
+                    shard.next = seq_.fetch_add(T(B), std::memory_order_relaxed);
+                    shard.limit = shard.next + T(B);
+                }
+                return shard.next++;
+            }
+        }
+        return seq_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    auto is_lock_free() const noexcept {
+        return seq_.is_lock_free();
+    }
+
 private:
     static_assert(std::is_unsigned_v<T>, "T must be unsigned numeric");
+    static_assert(B > 0, "Block size must be positive");
+    static_assert(B <= std::numeric_limits<T>::max(), "Block size must fit in T");
+
+    struct alignas(cache_line) shard_t {
+        T next{0};
+        T limit{0};
+    };
+
+    alignas(cache_line) std::atomic<T> seq_{0};
+    shard_t shards_[S];
+};
+
+class once_t final {
+public:
+    once_t() = default;
+    once_t(const once_t&) = delete;
+    auto operator=(const once_t&) = delete;
+
+    explicit operator bool() const noexcept {
+        return flag_.exchange(false);
+    }
+
+    auto operator!() const noexcept {
+        return !flag_.exchange(false);
+    }
+
+    void reset() noexcept {
+        flag_.store(true, std::memory_order_release);
+    }
+
+private:
+    mutable std::atomic<bool> flag_{true};
+};
+
+template <typename T, std::size_t S>
+class stack_t final {
+public:
+    stack_t() = default;
+    stack_t(const stack_t&) = delete;
+    auto operator=(const stack_t&) -> auto& = delete;
+
+    explicit operator bool() const noexcept {
+        return count_.load() > 0;
+    }
+
+    auto operator!() const noexcept {
+        return count_.load() < 1;
+    }
+
+    auto operator*() noexcept {
+        return pop();
+    }
+
+    auto operator<=(const T& item) {
+        return push(item);
+    }
+
+    auto size() const noexcept -> std::size_t {
+        auto count = count_.load();
+        if (count < 0) return std::size_t(0);
+        if (count > S) return S;
+        return count;
+    }
+
+    auto empty() const noexcept {
+        return count_.load() < 1;
+    }
+
+    auto full() const noexcept {
+        return count_.load() >= S;
+    }
+
+    auto push(const T& item) noexcept {
+        const auto count = count_.fetch_add(1);
+        if (count >= S) {
+            count_.fetch_sub(1);
+            return false;
+        }
+        data_[count] = item;
+        return true;
+    }
+
+    auto pull(T& item) noexcept {
+        const auto count = count_.fetch_sub(1);
+        if (count < 0) {
+            count_.fetch_add(1);
+            return false;
+        }
+        item = data_[count];
+        return true;
+    }
+
+    auto pop() noexcept -> std::optional<T> {
+        const auto count = count_.fetch_sub(1);
+        if (count < 0) {
+            count_.fetch_add(1);
+            return {};
+        }
+        return data_[count];
+    }
+
+private:
+    static_assert(S > 2, "Queue size must be bigger than 2");
+
+    std::atomic<int> count_{0};
+    T data_[S];
+};
+
+template <typename T>
+class lifo_t final {
+public:
+    lifo_t() = default;
+    lifo_t(const lifo_t&) = delete;
+    auto operator=(const lifo_t&) -> auto& = delete;
+
+    explicit lifo_t(std::size_t count) {
+        reserve(count);
+    }
+
+    ~lifo_t() {
+        auto index = index_of(head_.load(std::memory_order_acquire));
+        while (index) {
+            auto& item = at(index);
+            item.get()->~T();
+            index = item.next.load(std::memory_order_relaxed);
+        }
+        for (auto& chunk : chunks_)
+            delete[] chunk.load(std::memory_order_relaxed);
+    }
+
+    explicit operator bool() const noexcept {
+        return !empty();
+    }
+
+    auto operator!() const noexcept {
+        return empty();
+    }
+
+    auto operator*() {
+        return pop();
+    }
+
+    auto operator<=(const T& item) {
+        return push(item);
+    }
+
+    auto size() const noexcept -> std::size_t {
+        return count_.load(std::memory_order_relaxed);
+    }
+
+    auto empty() const noexcept {
+        return index_of(head_.load(std::memory_order_relaxed)) == 0;
+    }
+
+    auto capacity() const noexcept {
+        return chunk_base(chunks_used_.load(std::memory_order_acquire));
+    }
+
+    auto reserve(std::size_t count) {
+        while (capacity() < count) {
+            if (!grow()) return false;
+        }
+        return true;
+    }
+
+    auto push(const T& item) {
+        return emplace(item);
+    }
+
+    auto push(T&& item) {
+        return emplace(std::move(item));
+    }
+
+    template <typename... Args>
+    auto emplace(Args&&...args) {
+        const auto index = acquire();
+        if (!index) return false;
+        auto& item = at(index);
+        try {
+            ::new (static_cast<void *>(item.data)) T(std::forward<Args>(args)...);
+        } catch (...) {
+            link(free_, index, index);
+            throw;
+        }
+        // counted before it is published, so the pop that unlinks it always
+        // follows this in the count and size can never wrap below zero
+        count_.fetch_add(1, std::memory_order_relaxed);
+        link(head_, index, index);
+        return true;
+    }
+
+    auto pull(T& out) {
+        const auto index = unlink(head_);
+        if (!index) return false;
+        auto& item = at(index);
+        out = std::move(*item.get());
+        item.get()->~T();
+        link(free_, index, index);
+        count_.fetch_sub(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    auto pop() -> std::optional<T> {
+        const auto index = unlink(head_);
+        if (!index) return {};
+        auto& item = at(index);
+        std::optional<T> out(std::move(*item.get()));
+        item.get()->~T();
+        link(free_, index, index);
+        count_.fetch_sub(1, std::memory_order_relaxed);
+        return out;
+    }
+
+private:
+    // nodes are never freed until destruction, so a stale index is always
+    // safe to read; the tag in the upper half of the head defeats ABA.
+    struct node {
+        std::atomic<std::uint32_t> next{0};
+        alignas(T) unsigned char data[sizeof(T)];
+
+        auto get() noexcept { return std::launder(reinterpret_cast<T *>(data)); }
+    };
+
+    static constexpr std::size_t chunk_size = 64;
+    static constexpr std::size_t max_chunks = 26; // indexes fit in 32 bits
+
+    std::atomic<node *> chunks_[max_chunks]{};
+    std::atomic<std::size_t> chunks_used_{0};
+    alignas(cache_line) std::atomic<std::uint64_t> head_{0};
+    alignas(cache_line) std::atomic<std::uint64_t> free_{0};
+    alignas(cache_line) std::atomic<std::size_t> count_{0};
+
+    static constexpr auto chunk_base(std::size_t chunk) noexcept -> std::size_t {
+        return chunk_size * ((std::size_t(1) << chunk) - 1);
+    }
+
+    static constexpr auto index_of(std::uint64_t top) noexcept {
+        return static_cast<std::uint32_t>(top);
+    }
+
+    static constexpr auto pack(std::uint32_t index, std::uint64_t top) noexcept -> std::uint64_t {
+        return (((top >> 32) + 1) << 32) | index;
+    }
+
+    auto at(std::uint32_t index) const noexcept -> node& {
+        const auto pos = std::size_t(index - 1);
+        const auto chunk = std::size_t(detail::log2_floor(pos / chunk_size + 1));
+        return chunks_[chunk].load(std::memory_order_acquire)[pos - chunk_base(chunk)];
+    }
+
+    void link(std::atomic<std::uint64_t>& list, std::uint32_t first, std::uint32_t last) noexcept {
+        auto& tail = at(last);
+        auto top = list.load(std::memory_order_relaxed);
+        do { // NOLINT
+            tail.next.store(index_of(top), std::memory_order_relaxed);
+        } while (!list.compare_exchange_weak(top, pack(first, top), std::memory_order_release, std::memory_order_relaxed));
+    }
+
+    auto unlink(std::atomic<std::uint64_t>& list) noexcept -> std::uint32_t {
+        auto top = list.load(std::memory_order_acquire);
+        while (index_of(top)) {
+            const auto next = at(index_of(top)).next.load(std::memory_order_relaxed);
+            if (list.compare_exchange_weak(top, pack(next, top), std::memory_order_acquire, std::memory_order_acquire))
+                return index_of(top);
+        }
+        return 0;
+    }
+
+    auto acquire() -> std::uint32_t {
+        for (;;) {
+            const auto index = unlink(free_);
+            if (index || !grow()) return index;
+        }
+    }
+
+    auto grow() -> bool {
+        for (;;) {
+            auto chunk = chunks_used_.load(std::memory_order_acquire);
+            if (chunk >= max_chunks) return false;
+            if (chunks_[chunk].load(std::memory_order_acquire) != nullptr) {
+                chunks_used_.compare_exchange_strong(chunk, chunk + 1);
+                continue;
+            }
+
+            const auto count = chunk_size << chunk;
+            auto made = new node[count];
+            node *expected = nullptr;
+            if (!chunks_[chunk].compare_exchange_strong(expected, made, std::memory_order_acq_rel)) {
+                delete[] made;
+                continue;
+            }
+
+            const auto first = static_cast<std::uint32_t>(chunk_base(chunk) + 1);
+            for (std::size_t pos = 0; pos < count - 1; ++pos)
+                made[pos].next.store(first + pos + 1, std::memory_order_relaxed);
+            link(free_, first, static_cast<std::uint32_t>(first + count - 1));
+            chunks_used_.compare_exchange_strong(chunk, chunk + 1);
+            return true;
+        }
+    }
+};
+
+// Fixed size object pool. Each worker thread keeps a small magazine of free
+// slots it owns exclusively, and exchanges half magazines with a shared
+// lockfree depot, so most allocations touch no shared memory at all. Slabs
+// are never returned until the pool is destroyed, and chunks of at least a
+// huge page may be backed by huge pages. Objects still allocated when the
+// pool is destroyed are not destructed.
+template <typename T, std::size_t M = 32, std::size_t W = 64>
+class pool_t final {
+public:
+    class handle_t final {
+    public:
+        handle_t() = default;
+        handle_t(const handle_t&) = delete;
+        auto operator=(const handle_t&) -> auto& = delete;
+
+        handle_t(handle_t&& from) noexcept : pool_(from.pool_), ptr_(from.ptr_) {
+            from.ptr_ = nullptr;
+        }
+
+        ~handle_t() {
+            reset();
+        }
+
+        auto operator=(handle_t&& from) noexcept -> auto& {
+            if (&from == this) return *this;
+            reset();
+            pool_ = from.pool_;
+            ptr_ = from.ptr_;
+            from.ptr_ = nullptr;
+            return *this;
+        }
+
+        explicit operator bool() const noexcept {
+            return ptr_ != nullptr;
+        }
+
+        auto operator!() const noexcept {
+            return ptr_ == nullptr;
+        }
+
+        auto operator*() const noexcept -> T& {
+            return *ptr_;
+        }
+
+        auto operator->() const noexcept {
+            return ptr_;
+        }
+
+        auto get() const noexcept {
+            return ptr_;
+        }
+
+        auto release() noexcept {
+            auto ptr = ptr_;
+            ptr_ = nullptr;
+            return ptr;
+        }
+
+        void reset() noexcept {
+            if (ptr_) pool_->destroy(ptr_);
+            ptr_ = nullptr;
+        }
+
+    private:
+        friend class pool_t;
+
+        pool_t *pool_{nullptr};
+        T *ptr_{nullptr};
+
+        handle_t(pool_t *pool, T *ptr) noexcept : pool_(pool), ptr_(ptr) {}
+    };
+
+    explicit pool_t(std::size_t count = 0, bool huge = false) : huge_(huge) {
+        while (capacity() < count) {
+            if (!grow()) throw overflow("Pool reserve too large");
+        }
+    }
+
+    pool_t(const pool_t&) = delete;
+    auto operator=(const pool_t&) -> auto& = delete;
+
+    ~pool_t() {
+        for (std::size_t chunk = 0; chunk < max_chunks; ++chunk) {
+            auto made = chunks_[chunk].load(std::memory_order_relaxed);
+            if (!made) continue;
+            for (std::size_t pos = 0; pos < (chunk_size << chunk); ++pos)
+                made[pos].~node();
+            release(made, chunk);
+        }
+    }
+
+    // a pool shared by every user of T, never destroyed so it may be used
+    // from static and thread exit paths.
+    static auto shared() -> pool_t& {
+        static auto pool = new pool_t();
+        return *pool;
+    }
+
+    auto capacity() const noexcept {
+        return chunk_base(chunks_used_.load(std::memory_order_acquire));
+    }
+
+    auto huge_pages() const noexcept {
+        return huge_;
+    }
+
+    auto allocate() -> T * {
+        const auto id = detail::worker_id();
+        if (id >= W) {
+            auto& item = at(take());
+            const auto rest = item.next.load(std::memory_order_relaxed);
+            if (rest) give(rest);
+            return item.get();
+        }
+
+        auto& mag = mags_[id];
+        if (!mag.count) {
+            auto index = take();
+            while (index) {
+                mag.items[mag.count++] = index;
+                index = at(index).next.load(std::memory_order_relaxed);
+            }
+        }
+        return at(mag.items[--mag.count]).get();
+    }
+
+    void deallocate(T *ptr) noexcept {
+        if (!ptr) return;
+        auto& item = *reinterpret_cast<node *>(ptr);
+        const auto id = detail::worker_id();
+        if (id >= W) {
+            item.next.store(0, std::memory_order_relaxed);
+            give(item.self);
+            return;
+        }
+
+        auto& mag = mags_[id];
+        if (mag.count == M) {
+            mag.count -= batch;
+            for (std::size_t pos = 0; pos < batch; ++pos)
+                at(mag.items[mag.count + pos]).next.store(pos + 1 < batch ? mag.items[mag.count + pos + 1] : 0, std::memory_order_relaxed);
+            give(mag.items[mag.count]);
+        }
+        mag.items[mag.count++] = item.self;
+    }
+
+    template <typename... Args>
+    auto create(Args&&...args) -> T * {
+        auto ptr = allocate();
+        try {
+            return ::new (static_cast<void *>(ptr)) T(std::forward<Args>(args)...);
+        } catch (...) {
+            deallocate(ptr);
+            throw;
+        }
+    }
+
+    void destroy(T *ptr) noexcept {
+        if (!ptr) return;
+        ptr->~T();
+        deallocate(ptr);
+    }
+
+    template <typename... Args>
+    auto make(Args&&...args) {
+        return handle_t(this, create(std::forward<Args>(args)...));
+    }
+
+private:
+    static_assert(M >= 2 && M % 2 == 0, "Magazine size must be even");
+
+    // storage comes first so an object pointer is also its node pointer
+    struct node {
+        alignas(T) unsigned char data[sizeof(T)];
+        std::uint32_t self{0};
+        std::atomic<std::uint32_t> next{0};  // within a batch
+        std::atomic<std::uint32_t> chain{0}; // between batches in the depot
+
+        auto get() noexcept { return reinterpret_cast<T *>(data); }
+    };
+
+    struct alignas(cache_line) magazine_t {
+        std::uint32_t items[M]{};
+        std::size_t count{0};
+    };
+
+    static constexpr std::size_t batch = M / 2;
+    static constexpr std::size_t chunk_size = 64;
+    static constexpr std::size_t max_chunks = 26; // indexes fit in 32 bits
+    const bool huge_{false};
+    std::atomic<node *> chunks_[max_chunks]{};
+    std::atomic<std::size_t> chunks_used_{0};
+    alignas(cache_line) std::atomic<std::uint64_t> depot_{0};
+    magazine_t mags_[W];
+
+    static constexpr auto chunk_base(std::size_t chunk) noexcept -> std::size_t {
+        return chunk_size * ((std::size_t(1) << chunk) - 1);
+    }
+
+    static constexpr auto index_of(std::uint64_t top) noexcept {
+        return static_cast<std::uint32_t>(top);
+    }
+
+    static constexpr auto pack(std::uint32_t index, std::uint64_t top) noexcept -> std::uint64_t {
+        return (((top >> 32) + 1) << 32) | index;
+    }
+
+    static constexpr auto chunk_bytes(std::size_t chunk) noexcept {
+        return (chunk_size << chunk) * sizeof(node);
+    }
+
+    // small chunks would waste most of a huge page
+    auto huge_chunk(std::size_t chunk) const noexcept {
+        return huge_ && chunk_bytes(chunk) >= detail::huge_size;
+    }
+
+    auto at(std::uint32_t index) const noexcept -> node& {
+        const auto pos = std::size_t(index - 1);
+        const auto chunk = std::size_t(detail::log2_floor(pos / chunk_size + 1));
+        return chunks_[chunk].load(std::memory_order_acquire)[pos - chunk_base(chunk)];
+    }
+
+    void link(std::uint32_t first, std::uint32_t last) noexcept {
+        auto& tail = at(last);
+        auto top = depot_.load(std::memory_order_relaxed);
+        do { // NOLINT
+            tail.chain.store(index_of(top), std::memory_order_relaxed);
+        } while (!depot_.compare_exchange_weak(top, pack(first, top), std::memory_order_release, std::memory_order_relaxed));
+    }
+
+    void give(std::uint32_t index) noexcept {
+        link(index, index);
+    }
+
+    // pop a batch from the depot, growing the pool when it is empty
+    auto take() -> std::uint32_t {
+        for (;;) {
+            auto top = depot_.load(std::memory_order_acquire);
+            while (index_of(top)) {
+                const auto next = at(index_of(top)).chain.load(std::memory_order_relaxed);
+                if (depot_.compare_exchange_weak(top, pack(next, top), std::memory_order_acquire, std::memory_order_acquire))
+                    return index_of(top);
+            }
+            if (!grow()) throw std::bad_alloc();
+        }
+    }
+
+    auto reserve(std::size_t chunk) -> node * {
+        auto made = static_cast<node *>(detail::map_pages(chunk_bytes(chunk), alignof(node), huge_chunk(chunk)));
+        for (std::size_t pos = 0; pos < (chunk_size << chunk); ++pos)
+            ::new (static_cast<void *>(made + pos)) node();
+        return made;
+    }
+
+    void release(node *made, std::size_t chunk) noexcept {
+        detail::unmap_pages(made, chunk_bytes(chunk), alignof(node), huge_chunk(chunk));
+    }
+
+    auto grow() -> bool {
+        for (;;) {
+            auto chunk = chunks_used_.load(std::memory_order_acquire);
+            if (chunk >= max_chunks) return false;
+            if (chunks_[chunk].load(std::memory_order_acquire) != nullptr) {
+                chunks_used_.compare_exchange_strong(chunk, chunk + 1);
+                continue;
+            }
+
+            const auto count = chunk_size << chunk;
+            const auto first = static_cast<std::uint32_t>(chunk_base(chunk) + 1);
+            auto made = reserve(chunk);
+            for (std::size_t pos = 0; pos < count; ++pos) {
+                const auto index = static_cast<std::uint32_t>(first + pos);
+                const auto last = (pos + 1) % batch == 0 || pos + 1 == count;
+                made[pos].self = index;
+                made[pos].next.store(last ? 0 : index + 1, std::memory_order_relaxed);
+                if (pos % batch == 0 && pos + batch < count)
+                    made[pos].chain.store(index + batch, std::memory_order_relaxed);
+            }
+
+            node *expected = nullptr;
+            if (!chunks_[chunk].compare_exchange_strong(expected, made, std::memory_order_acq_rel)) {
+                for (std::size_t pos = 0; pos < count; ++pos)
+                    made[pos].~node();
+                release(made, chunk);
+                continue;
+            }
+
+            link(first, static_cast<std::uint32_t>(first + ((count - 1) / batch) * batch));
+            chunks_used_.compare_exchange_strong(chunk, chunk + 1);
+            return true;
+        }
+    }
+};
+
+// Standard allocator that serves single element requests, as node based
+// standard containers make, from the shared pool for each rebound type. The
+// lockfree containers here retire their nodes thru the epoch domain and
+// still allocate them with new.
+template <typename T>
+class pool_allocator {
+public:
+    using value_type = T;
+
+    pool_allocator() noexcept = default;
+
+    template <typename U>
+    pool_allocator(const pool_allocator<U>&) noexcept {} // NOLINT
+
+    auto allocate(std::size_t count) -> T * {
+        if (count == 1) return pool_t<T>::shared().allocate();
+        return static_cast<T *>(::operator new(count * sizeof(T), std::align_val_t(alignof(T))));
+    }
+
+    void deallocate(T *ptr, std::size_t count) noexcept {
+        if (count == 1)
+            pool_t<T>::shared().deallocate(ptr);
+        else
+            ::operator delete(ptr, std::align_val_t(alignof(T)));
+    }
+
+    template <typename U>
+    auto operator==(const pool_allocator<U>&) const noexcept {
+        return true;
+    }
+
+    template <typename U>
+    auto operator!=(const pool_allocator<U>&) const noexcept {
+        return false;
+    }
+};
+
+// Single producer / single consumer ring. Producer and consumer state live
+// on separate cache lines, and each side keeps a cached copy of the other
+// side's index so the shared line is only read when the ring looks full or
+// empty. Positions run free, so all S slots are usable.
+template <typename T, std::size_t S>
+class buffer_t final {
+public:
+    buffer_t() = default;
+    buffer_t(const buffer_t&) = delete;
+    auto operator=(const buffer_t&) -> auto& = delete;
+
+    explicit operator bool() const noexcept {
+        return !empty();
+    }
+
+    auto operator!() const noexcept {
+        return empty();
+    }
+
+    auto operator*() noexcept {
+        return pop();
+    }
+
+    auto operator<=(const T& item) noexcept {
+        return push(item);
+    }
+
+    auto capacity() const noexcept {
+        return S;
+    }
+
+    // head first, so the tail read after it is never behind it
+    auto size() const noexcept -> std::size_t {
+        const auto head = consumer_.head.load(std::memory_order_acquire);
+        const auto tail = producer_.tail.load(std::memory_order_acquire);
+        return tail - head > S ? S : tail - head;
+    }
+
+    auto empty() const noexcept {
+        return consumer_.head.load(std::memory_order_relaxed) == producer_.tail.load(std::memory_order_relaxed);
+    }
+
+    auto full() const noexcept {
+        return size() >= S;
+    }
+
+    auto push(const T& item) noexcept {
+        const auto tail = producer_.tail.load(std::memory_order_relaxed);
+        if (tail - producer_.head >= S) {
+            producer_.head = consumer_.head.load(std::memory_order_acquire);
+            if (tail - producer_.head >= S) return false;
+        }
+
+        data_[util::wrap_index<S>(tail)] = item;
+        producer_.tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    auto pull(T& item) noexcept {
+        const auto head = consumer_.head.load(std::memory_order_relaxed);
+        if (head == consumer_.tail) {
+            consumer_.tail = producer_.tail.load(std::memory_order_acquire);
+            if (head == consumer_.tail) return false;
+        }
+
+        item = data_[util::wrap_index<S>(head)];
+        consumer_.head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    auto pop() noexcept -> std::optional<T> {
+        T item;
+        if (!pull(item)) return {};
+        return item;
+    }
+
+private:
+    static_assert(S > 2, "Queue size must be bigger than 2");
+
+    struct alignas(cache_line) producer_t {
+        std::atomic<std::size_t> tail{0};
+        std::size_t head{0}; // cached consumer position
+    };
+
+    struct alignas(cache_line) consumer_t {
+        std::atomic<std::size_t> head{0};
+        std::size_t tail{0}; // cached producer position
+    };
+
+    producer_t producer_;
+    consumer_t consumer_;
+    alignas(cache_line) T data_[S];
+};
+
+template <typename T, std::size_t S>
+class ring_t final {
+public:
+    ring_t() noexcept {
+        for (std::size_t pos = 0; pos < S; ++pos)
+            cells_[pos].seq.store(pos, std::memory_order_relaxed);
+    }
+
+    ring_t(const ring_t&) = delete;
+    auto operator=(const ring_t&) -> auto& = delete;
+
+    ~ring_t() {
+        const auto tail = tail_.load(std::memory_order_relaxed);
+        for (auto pos = head_.load(std::memory_order_relaxed); pos != tail; ++pos) {
+            auto& cell = cells_[util::wrap_index<S>(pos)];
+            if (cell.seq.load(std::memory_order_relaxed) == pos + 1)
+                cell.get()->~T();
+        }
+    }
+
+    explicit operator bool() const noexcept {
+        return !empty();
+    }
+
+    auto operator!() const noexcept {
+        return empty();
+    }
+
+    auto operator*() noexcept {
+        return pop();
+    }
+
+    auto operator<=(const T& item) {
+        return try_push(item);
+    }
+
+    auto operator<=(T&& item) noexcept {
+        return try_push(std::move(item));
+    }
+
+    auto capacity() const noexcept {
+        return S;
+    }
+
+    auto size() const noexcept -> std::size_t {
+        const auto head = head_.load(std::memory_order_relaxed);
+        const auto tail = tail_.load(std::memory_order_relaxed);
+        if (tail <= head) return 0;
+        if (tail - head > S) return S;
+        return tail - head;
+    }
+
+    auto empty() const noexcept {
+        return size() == 0;
+    }
+
+    auto full() const noexcept {
+        return size() >= S;
+    }
+
+    auto try_push(const T& item) {
+        T copy(item);
+        return try_push(std::move(copy));
+    }
+
+    auto try_push(T&& item) noexcept {
+        std::size_t pos{0};
+        if (!claim(tail_, 0, 1, pos)) return false;
+        auto& cell = cells_[util::wrap_index<S>(pos)];
+        ::new (static_cast<void *>(cell.data)) T(std::move(item));
+        cell.seq.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    auto try_pop(T& item) noexcept {
+        std::size_t pos{0};
+        if (!claim(head_, 1, 1, pos)) return false;
+        auto& cell = cells_[util::wrap_index<S>(pos)];
+        item = std::move(*cell.get());
+        cell.get()->~T();
+        cell.seq.store(pos + S, std::memory_order_release);
+        return true;
+    }
+
+    auto pop() noexcept -> std::optional<T> {
+        std::size_t pos{0};
+        if (!claim(head_, 1, 1, pos)) return {};
+        auto& cell = cells_[util::wrap_index<S>(pos)];
+        std::optional<T> item(std::move(*cell.get()));
+        cell.get()->~T();
+        cell.seq.store(pos + S, std::memory_order_release);
+        return item;
+    }
+
+    // moves up to count items from the input; returns how many were pushed
+    template <typename Iter>
+    auto push_n(Iter first, std::size_t count) noexcept -> std::size_t {
+        std::size_t pos{0};
+        const auto claimed = claim(tail_, 0, count, pos);
+        for (std::size_t offset = 0; offset < claimed; ++offset, ++first) {
+            auto& cell = cells_[util::wrap_index<S>(pos + offset)];
+            ::new (static_cast<void *>(cell.data)) T(std::move(*first));
+            cell.seq.store(pos + offset + 1, std::memory_order_release);
+        }
+        return claimed;
+    }
+
+    // moves up to max items to the output; if writing to it throws, the
+    // items still claimed are destroyed so their cells are not lost
+    template <typename Out>
+    auto pop_n(Out out, std::size_t max) -> std::size_t {
+        std::size_t pos{0};
+        const auto claimed = claim(head_, 1, max, pos);
+        std::size_t offset = 0;
+        try {
+            for (; offset < claimed; ++offset, ++out) {
+                auto& cell = cells_[util::wrap_index<S>(pos + offset)];
+                *out = std::move(*cell.get());
+                cell.get()->~T();
+                cell.seq.store(pos + offset + S, std::memory_order_release);
+            }
+        } catch (...) {
+            for (; offset < claimed; ++offset) {
+                auto& cell = cells_[util::wrap_index<S>(pos + offset)];
+                cell.get()->~T();
+                cell.seq.store(pos + offset + S, std::memory_order_release);
+            }
+            throw;
+        }
+        return claimed;
+    }
+
+private:
+    static_assert(S > 1, "Ring size must be bigger than 1");
+    static_assert(std::is_nothrow_move_constructible_v<T>, "T must be nothrow move constructible");
+
+    struct cell {
+        std::atomic<std::size_t> seq{0};
+        alignas(T) unsigned char data[sizeof(T)];
+
+        auto get() noexcept { return std::launder(reinterpret_cast<T *>(data)); }
+    };
+
+    alignas(cache_line) std::atomic<std::size_t> head_{0};
+    alignas(cache_line) std::atomic<std::size_t> tail_{0};
+    alignas(cache_line) cell cells_[S];
+
+    // claim up to limit contiguous cells whose sequence matches pos + offset
+    auto claim(std::atomic<std::size_t>& index, std::size_t offset, std::size_t limit, std::size_t& pos) noexcept -> std::size_t {
+        pos = index.load(std::memory_order_relaxed);
+        while (limit) {
+            std::size_t count = 0;
+            auto diff = std::intptr_t(0);
+            while (count < limit) {
+                const auto seq = cells_[util::wrap_index<S>(pos + count)].seq.load(std::memory_order_acquire);
+                diff = static_cast<std::intptr_t>(seq - (pos + count + offset));
+                if (diff != 0) break;
+                ++count;
+            }
+
+            if (!count) {
+                if (diff < 0) return 0; // full or empty
+                pos = index.load(std::memory_order_relaxed);
+                continue;
+            }
+
+            if (index.compare_exchange_weak(pos, pos + count, std::memory_order_relaxed))
+                return count;
+        }
+        return 0;
+    }
+};
+
+// Epoch based reclamation. Readers announce the epoch they entered in a per
+// worker slot, and retired objects are only reclaimed once the global epoch
+// has advanced twice past the epoch they were retired in.
+class epoch_t final {
+public:
+    using counter_t = std::atomic<std::size_t>;
+
+    epoch_t() = default;
+    epoch_t(const epoch_t&) = delete;
+    auto operator=(const epoch_t&) -> auto& = delete;
+
+    ~epoch_t() {
+        for (auto& list : limbo_)
+            reclaim(list.exchange(nullptr, std::memory_order_acquire));
+    }
+
+    auto current() const noexcept {
+        return epoch_.load(std::memory_order_acquire);
+    }
+
+    auto pending() const noexcept -> std::size_t {
+        return pending_.load(std::memory_order_relaxed);
+    }
+
+    auto enter() noexcept -> counter_t * {
+        auto& slot = slots_[detail::worker_id() % slot_count];
+        for (;;) {
+            const auto epoch = epoch_.load(std::memory_order_seq_cst);
+            auto& active = slot.active[epoch % 3];
+            active.fetch_add(1, std::memory_order_seq_cst);
+            if (epoch_.load(std::memory_order_seq_cst) == epoch) return &active;
+            active.fetch_sub(1, std::memory_order_release);
+        }
+    }
+
+    static void leave(counter_t *active) noexcept {
+        active->fetch_sub(1, std::memory_order_release);
+    }
+
+    template <typename T>
+    void retire(T *obj) {
+        retire(obj, [](void *ptr) { delete static_cast<T *>(ptr); });
+    }
+
+    void retire(void *obj, void (*release)(void *)) {
+        if (obj == nullptr) return;
+        auto made = new retired{nullptr, obj, release};
+        auto& list = limbo_[epoch_.load(std::memory_order_seq_cst) % 3];
+        auto top = list.load(std::memory_order_relaxed);
+        do { // NOLINT
+            made->next = top;
+        } while (!list.compare_exchange_weak(top, made, std::memory_order_release, std::memory_order_relaxed));
+        if (pending_.fetch_add(1, std::memory_order_relaxed) % collect_interval == collect_interval - 1)
+            collect();
+    }
+
+    // try to advance the epoch; fails while readers remain in the prior one
+    auto collect() -> bool {
+        if (busy_.test_and_set(std::memory_order_acquire)) return false;
+        const auto epoch = epoch_.load(std::memory_order_seq_cst);
+        for (const auto& slot : slots_) {
+            if (slot.active[(epoch + 2) % 3].load(std::memory_order_seq_cst) != 0) {
+                busy_.clear(std::memory_order_release);
+                return false;
+            }
+        }
+
+        epoch_.store(epoch + 1, std::memory_order_seq_cst);
+        auto list = limbo_[(epoch + 1) % 3].exchange(nullptr, std::memory_order_acq_rel);
+        busy_.clear(std::memory_order_release);
+        reclaim(list);
+        return true;
+    }
+
+    // wait until everything retired before the call has been reclaimed. The
+    // calling hpx thread must not hold an epoch_guard, which pins the epoch
+    // so this would wait forever. This is not checked, since guards belong to
+    // hpx threads that may migrate and interleave on one os thread.
+    template <typename Yield>
+    void synchronize(Yield yield) {
+        const auto target = current() + 3;
+        while (current() < target) {
+            if (!collect()) yield();
+        }
+    }
+
+private:
+    struct retired {
+        retired *next{nullptr};
+        void *ptr{nullptr};
+        void (*release)(void *){nullptr};
+    };
+
+    struct alignas(cache_line) slot_t {
+        counter_t active[3]{};
+    };
+
+    static constexpr std::size_t slot_count = 64;
+    static constexpr std::size_t collect_interval = 64;
+
+    slot_t slots_[slot_count];
+    alignas(cache_line) std::atomic<std::uint64_t> epoch_{0};
+    alignas(cache_line) std::atomic<std::size_t> pending_{0};
+    std::atomic_flag busy_ = ATOMIC_FLAG_INIT;
+    std::atomic<retired *> limbo_[3]{};
+
+    void reclaim(retired *list) noexcept {
+        while (list != nullptr) {
+            auto next = list->next;
+            list->release(list->ptr);
+            delete list;
+            pending_.fetch_sub(1, std::memory_order_relaxed);
+            list = next;
+        }
+    }
+};
+
+inline auto epoch() -> epoch_t& {
+    static epoch_t domain;
+    return domain;
+}
+
+// Nothing retired after a guard is entered is reclaimed until it leaves, in
+// any thread, so long lived guards such as skiplist ranges stall reclamation
+// for the whole domain.
+class epoch_guard final {
+public:
+    explicit epoch_guard(epoch_t& domain = epoch()) noexcept : active_(domain.enter()) {}
+
+    ~epoch_guard() {
+        epoch_t::leave(active_);
+    }
+
+    epoch_guard(const epoch_guard&) = delete;
+    auto operator=(const epoch_guard&) -> auto& = delete;
+
+private:
+    epoch_t::counter_t *active_;
+};
+
+// Read-copy-update pointer to an immutable version of T. Readers hold a
+// reader guard and never write shared memory; writers publish a new
+// version with a single exchange or compare and swap and never wait for
+// readers. Replaced versions are retired to the epoch domain and freed
+// once every reader that could still see them has left.
+template <typename T>
+class rcu_ptr final {
+public:
+    class reader_t final {
+    public:
+        reader_t(const reader_t&) = delete;
+        auto operator=(const reader_t&) -> auto& = delete;
+
+        explicit operator bool() const noexcept {
+            return ptr_ != nullptr;
+        }
+
+        auto operator!() const noexcept {
+            return ptr_ == nullptr;
+        }
+
+        auto operator->() const {
+            if (!ptr_) throw error("rcu reader empty");
+            return ptr_;
+        }
+
+        auto operator*() const -> const T& {
+            if (!ptr_) throw error("rcu reader empty");
+            return *ptr_;
+        }
+
+        auto get() const noexcept {
+            return ptr_;
+        }
+
+    private:
+        friend class rcu_ptr;
+
+        const epoch_guard guard_;
+        const T *ptr_{nullptr};
+
+        explicit reader_t(const std::atomic<T *>& ptr) noexcept : ptr_(ptr.load(std::memory_order_acquire)) {}
+    };
+
+    rcu_ptr() = default;
+    rcu_ptr(const rcu_ptr&) = delete;
+    auto operator=(const rcu_ptr&) -> auto& = delete;
+
+    explicit rcu_ptr(T *init) noexcept : ptr_(init) {}
+
+    ~rcu_ptr() {
+        delete ptr_.load(std::memory_order_acquire);
+    }
+
+    explicit operator bool() const noexcept {
+        return ptr_.load(std::memory_order_acquire) != nullptr;
+    }
+
+    auto operator!() const noexcept {
+        return ptr_.load(std::memory_order_acquire) == nullptr;
+    }
+
+    auto read() const noexcept {
+        return reader_t(ptr_);
+    }
+
+    void store(T *next) {
+        epoch().retire(ptr_.exchange(next, std::memory_order_acq_rel));
+    }
+
+    template <typename... Args>
+    void emplace(Args&&...args) {
+        store(new T(std::forward<Args>(args)...));
+    }
+
+    // copy the current version, change the copy, and publish it; retried
+    // if another writer published first.
+    template <typename Func>
+    void update(Func func) {
+        const epoch_guard guard;
+        auto current = ptr_.load(std::memory_order_acquire);
+        for (;;) {
+            auto next = current ? std::make_unique<T>(*current) : std::make_unique<T>();
+            func(*next);
+            if (ptr_.compare_exchange_strong(current, next.get(), std::memory_order_acq_rel, std::memory_order_acquire)) {
+                next.release();
+                epoch().retire(current);
+                return;
+            }
+        }
+    }
+
+    // wait for a grace period, after which no reader sees a prior version;
+    // never call this while holding a reader or other epoch guard
+    template <typename Yield>
+    void synchronize(Yield yield) const {
+        epoch().synchronize(yield);
+    }
+
+private:
+    std::atomic<T *> ptr_{nullptr};
+};
+
+// Chase-Lev work stealing deque, using the C11 orderings of Le et al. The
+// owner pushes and pops at the bottom, thieves steal from the top. Arrays
+// replaced by growth are retired to the epoch domain since a thief may
+// still be reading from them.
+template <typename T>
+class deque_t final {
+public:
+    struct stats_t {
+        std::size_t steals{0};
+        std::size_t empty{0};
+        std::size_t aborted{0};
+    };
+
+    explicit deque_t(std::size_t capacity = 64) : array_(new array_t(capacity)) {}
+    deque_t(const deque_t&) = delete;
+    auto operator=(const deque_t&) -> auto& = delete;
+
+    ~deque_t() {
+        delete array_.load(std::memory_order_relaxed);
+    }
+
+    explicit operator bool() const noexcept {
+        return !empty();
+    }
+
+    auto operator!() const noexcept {
+        return empty();
+    }
+
+    auto size() const noexcept -> std::size_t {
+        const auto bottom = bottom_.load(std::memory_order_relaxed);
+        const auto top = top_.load(std::memory_order_relaxed);
+        return bottom > top ? std::size_t(bottom - top) : 0;
+    }
+
+    auto empty() const noexcept {
+        return size() == 0;
+    }
+
+    auto capacity() const noexcept -> std::size_t {
+        return array_.load(std::memory_order_relaxed)->size();
+    }
+
+    auto stats() const noexcept {
+        return stats_t{steals_.load(std::memory_order_relaxed), empty_.load(std::memory_order_relaxed), aborted_.load(std::memory_order_relaxed)};
+    }
+
+    // owner only
+    void push_bottom(T item) {
+        const auto bottom = bottom_.load(std::memory_order_relaxed);
+        const auto top = top_.load(std::memory_order_acquire);
+        auto array = array_.load(std::memory_order_relaxed);
+        if (bottom - top > std::int64_t(array->size()) - 1)
+            array = grow(array, bottom, top);
+        array->put(bottom, item);
+        std::atomic_thread_fence(std::memory_order_release);
+        bottom_.store(bottom + 1, std::memory_order_relaxed);
+    }
+
+    // owner only
+    auto pop_bottom() -> std::optional<T> {
+        const auto bottom = bottom_.load(std::memory_order_relaxed) - 1;
+        auto array = array_.load(std::memory_order_relaxed);
+        bottom_.store(bottom, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        auto top = top_.load(std::memory_order_relaxed);
+        if (top > bottom) {
+            bottom_.store(bottom + 1, std::memory_order_relaxed);
+            return std::nullopt;
+        }
+
+        std::optional<T> item(array->get(bottom));
+        if (top == bottom) {
+            if (!top_.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+                item.reset();
+            bottom_.store(bottom + 1, std::memory_order_relaxed);
+        }
+        return item;
+    }
+
+    // any thread; fails if empty or if another thread won the race
+    auto steal() -> std::optional<T> {
+        const epoch_guard guard;
+        auto top = top_.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        const auto bottom = bottom_.load(std::memory_order_acquire);
+        if (top >= bottom) {
+            empty_.fetch_add(1, std::memory_order_relaxed);
+            return std::nullopt;
+        }
+
+        const auto item = array_.load(std::memory_order_acquire)->get(top);
+        if (!top_.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+            aborted_.fetch_add(1, std::memory_order_relaxed);
+            return std::nullopt;
+        }
+        steals_.fetch_add(1, std::memory_order_relaxed);
+        return item;
+    }
+
+private:
+    static_assert(std::is_trivially_copyable_v<T>, "T must be trivially copyable");
+
+    class array_t final {
+    public:
+        explicit array_t(std::size_t size) : mask_(size - 1), items_(new std::atomic<T>[size]) {
+            if (!size || (size & mask_)) throw invalid("Deque capacity must be a power of two");
+        }
+
+        auto size() const noexcept { return mask_ + 1; }
+
+        auto get(std::int64_t pos) const noexcept {
+            return items_[std::size_t(pos) & mask_].load(std::memory_order_relaxed);
+        }
+
+        void put(std::int64_t pos, T item) noexcept {
+            items_[std::size_t(pos) & mask_].store(item, std::memory_order_relaxed);
+        }
+
+    private:
+        const std::size_t mask_;
+        std::unique_ptr<std::atomic<T>[]> items_;
+    };
+
+    alignas(cache_line) std::atomic<std::int64_t> top_{0};
+    alignas(cache_line) std::atomic<std::int64_t> bottom_{0};
+    std::atomic<array_t *> array_;
+    alignas(cache_line) std::atomic<std::size_t> steals_{0};
+    std::atomic<std::size_t> empty_{0};
+    std::atomic<std::size_t> aborted_{0};
+
+    auto grow(array_t *array, std::int64_t bottom, std::int64_t top) -> array_t * {
+        auto made = new array_t(array->size() * 2);
+        for (auto pos = top; pos < bottom; ++pos)
+            made->put(pos, array->get(pos));
+        array_.store(made, std::memory_order_release);
+        epoch().retire(array);
+        return made;
+    }
+};
+
+template <typename K, typename V, std::size_t S = 16>
+class dictionary_t {
+public:
+    dictionary_t() = default;
+    dictionary_t(const dictionary_t&) = delete;
+    auto operator=(const dictionary_t&) -> auto& = delete;
+
+    dictionary_t(dictionary_t&& other) noexcept : count_(other.count_.exchange(0)) {
+        for (std::size_t index = 0; index < S; ++index)
+            table_[index].store(other.table_[index].exchange(0));
+    }
+
+    auto operator=(dictionary_t&& other) noexcept -> auto& {
+        if (this != &other) {
+            release();
+            for (std::size_t index = 0; index < S; ++index)
+                table_[index].store(other.table_[index].exchange(0));
+            count_.store(other.count_.exchange(0));
+        }
+        return *this;
+    }
+
+    ~dictionary_t() {
+        release();
+    }
+
+    explicit operator bool() const noexcept {
+        return count_.load() > 0;
+    }
+
+    auto operator!() const noexcept {
+        return count_.load() == 0;
+    }
+
+    // values may be replaced or removed concurrently, so they are returned
+    // by copy rather than by reference
+    auto operator[](const K& key) const -> V {
+        return at(key);
+    }
+
+    void clear() {
+        const epoch_guard guard;
+        for (std::size_t index = 0; index < S; ++index) {
+            auto current = ptr(table_[index].load(std::memory_order_acquire));
+            while (current != nullptr) {
+                auto next = current->next.load(std::memory_order_acquire);
+                if (!marked(next) && current->next.compare_exchange_strong(next, next | 1U, std::memory_order_acq_rel))
+                    count_.fetch_sub(1, std::memory_order_relaxed);
+                current = ptr(next);
+            }
+
+            std::atomic<std::uintptr_t> *prev{nullptr};
+            search(index, nullptr, prev, current);
+        }
+    }
+
+    auto insert(const K& key, const V& value) {
+        push(new node(key, new V(value)));
+        return true;
+    }
+
+    auto insert_or_assign(const K& key, const V& value) {
+        const epoch_guard guard;
+        place(key, [&] { return new node(key, new V(value)); }, [&value](node *current) {
+            epoch().retire(current->value.exchange(new V(value), std::memory_order_acq_rel));
+        });
+        return true;
+    }
+
+    auto emplace(K&& key, V&& value) {
+        push(new node(std::move(key), new V(std::move(value))));
+        return true;
+    }
+
+    auto try_emplace(K&& key, V&& value) {
+        const epoch_guard guard;
+        return place(key, [&] { return new node(std::move(key), new V(std::move(value))); }, [](node *) {});
+    }
+
+    auto find(const K& key) const -> std::optional<V> {
+        const epoch_guard guard;
+        auto current = lookup(key);
+        if (current == nullptr) return std::nullopt;
+        return *current->value.load(std::memory_order_acquire);
+    }
+
+    auto contains(const K& key) const {
+        const epoch_guard guard;
+        return lookup(key) != nullptr;
+    }
+
+    auto at(const K& key) const -> V {
+        const epoch_guard guard;
+        auto current = lookup(key);
+        if (current == nullptr) throw range("Key not in dictionary");
+        return *current->value.load(std::memory_order_acquire);
+    }
+
+    auto remove(const K& key) {
+        const epoch_guard guard;
+        const auto index = key_index(key);
+        std::atomic<std::uintptr_t> *prev{nullptr};
+        node *current{nullptr};
+        for (;;) {
+            if (!search(index, &key, prev, current)) return false;
+            auto next = current->next.load(std::memory_order_acquire);
+            if (marked(next)) continue;
+            if (!current->next.compare_exchange_strong(next, next | 1U, std::memory_order_acq_rel)) continue;
+            count_.fetch_sub(1, std::memory_order_relaxed);
+            auto expected = std::uintptr_t(current);
+            if (prev->compare_exchange_strong(expected, next, std::memory_order_acq_rel))
+                epoch().retire(current);
+            else
+                search(index, nullptr, prev, current);
+            return true;
+        }
+    }
+
+    auto empty() const noexcept {
+        return count_.load() == 0;
+    }
+
+    auto size() const noexcept {
+        return count_.load();
+    }
+
+    auto keys() const {
+        std::list<K> list;
+        const epoch_guard guard;
+        for (std::size_t index = 0; index < S; ++index) {
+            walk(index, [&list](const K& key, const V&) {
+                list.push_back(key);
+            });
+        }
+        return list;
+    }
+
+    auto keys_into(std::vector<K>& list) const {
+        const auto prior = list.size();
+        list.reserve(prior + size());
+        const epoch_guard guard;
+        for (std::size_t index = 0; index < S; ++index) {
+            walk(index, [&list](const K& key, const V&) {
+                list.push_back(key);
+            });
+        }
+        return list.size() - prior;
+    }
+
+    auto snapshot() const {
+        std::vector<std::pair<K, V>> list;
+        list.reserve(size());
+        const epoch_guard guard;
+        for (std::size_t index = 0; index < S; ++index) {
+            walk(index, [&list](const K& key, const V& value) {
+                list.emplace_back(key, value);
+            });
+        }
+        return list;
+    }
+
+    template <typename Func>
+    void each(Func func) const {
+        const epoch_guard guard;
+        for (std::size_t index = 0; index < S; ++index)
+            walk(index, func);
+    }
+
+    // buckets are split across hpx tasks; func must be safe to call
+    // concurrently, and like each is only given const values
+    template <typename Policy, typename Func>
+    void for_each_par(Policy&& policy, Func func) const {
+        hpx::experimental::for_loop(std::forward<Policy>(policy), std::size_t(0), S, [this, &func](std::size_t index) {
+            const epoch_guard guard;
+            walk(index, func);
+        });
+    }
+
+    template <typename Policy, typename T, typename Reduce, typename Transform>
+    auto transform_reduce(Policy&& policy, T init, Reduce reduce, Transform transform) const -> T {
+        std::vector<std::optional<T>> partial(S);
+        hpx::experimental::for_loop(std::forward<Policy>(policy), std::size_t(0), S, [&](std::size_t index) {
+            auto& result = partial[index];
+            const epoch_guard guard;
+            walk(index, [&](const K& key, const V& value) {
+                if (result)
+                    result = reduce(std::move(*result), transform(key, value));
+                else
+                    result.emplace(transform(key, value));
+            });
+        });
+
+        for (auto& result : partial) {
+            if (result)
+                init = reduce(std::move(init), std::move(*result));
+        }
+        return init;
+    }
+
+private:
+    struct node {
+        const K key;
+        std::atomic<V *> value{nullptr};
+        std::atomic<std::uintptr_t> next{0};
+
+        node(const K& k, V *v) : key(k), value(v) {}
+        node(K&& k, V *v) : key(std::move(k)), value(v) {}
+        ~node() { delete value.load(std::memory_order_relaxed); }
+    };
+
+    mutable std::atomic<std::uintptr_t> table_[S]{};
+    std::atomic<std::size_t> count_{0};
+
+    static auto ptr(std::uintptr_t next) noexcept {
+        return reinterpret_cast<node *>(next & ~std::uintptr_t(1));
+    }
+
+    static constexpr auto marked(std::uintptr_t next) noexcept {
+        return (next & 1U) != 0;
+    }
+
+    auto key_index(const K& key) const -> std::size_t {
+        return std::hash<K>()(key) % S;
+    }
+
+    void release() noexcept {
+        for (auto& bucket : table_) {
+            auto current = ptr(bucket.exchange(0));
+            while (current != nullptr) {
+                auto next = ptr(current->next.load(std::memory_order_relaxed));
+                delete current;
+                current = next;
+            }
+        }
+        count_.store(0);
+    }
+
+    void push(node *made) {
+        auto& bucket = table_[key_index(made->key)];
+        auto top = bucket.load(std::memory_order_relaxed);
+        do { // NOLINT
+            made->next.store(top, std::memory_order_relaxed);
+        } while (!bucket.compare_exchange_weak(top, std::uintptr_t(made), std::memory_order_release, std::memory_order_relaxed));
+        count_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // links a new node at the tail link a failed search ends on, so two
+    // racing inserts of one key cannot both succeed; the loser finds the
+    // winner on retry and either way only one node holds the key
+    template <typename Make, typename Found>
+    auto place(const K& key, Make make, Found found) -> bool {
+        const auto index = key_index(key);
+        const K *target = &key;
+        std::unique_ptr<node> made;
+        std::atomic<std::uintptr_t> *prev{nullptr};
+        node *current{nullptr};
+        for (;;) {
+            if (search(index, target, prev, current)) {
+                found(current);
+                return false;
+            }
+
+            if (!made) {
+                made.reset(make());
+                target = &made->key; // key may have been moved from
+            }
+
+            std::uintptr_t expected{0};
+            if (prev->compare_exchange_strong(expected, std::uintptr_t(made.get()), std::memory_order_acq_rel, std::memory_order_acquire)) {
+                made.release();
+                count_.fetch_add(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+    }
+
+    auto lookup(const K& key) const -> node * {
+        std::atomic<std::uintptr_t> *prev{nullptr};
+        node *current{nullptr};
+        if (!search(key_index(key), &key, prev, current)) return nullptr;
+        return current;
+    }
+
+    template <typename Func>
+    void walk(std::size_t index, Func&& func) const {
+        auto current = ptr(table_[index].load(std::memory_order_acquire));
+        while (current != nullptr) {
+            const auto next = current->next.load(std::memory_order_acquire);
+            if (!marked(next)) { // values are shared, so never written in place
+                const V& value = *current->value.load(std::memory_order_acquire);
+                func(current->key, value);
+            }
+            current = ptr(next);
+        }
+    }
+
+    // unlinks marked nodes while searching; with no key it purges the bucket
+    auto search(std::size_t index, const K *key, std::atomic<std::uintptr_t> *&prev, node *&current) const -> bool {
+        for (;;) {
+            prev = &table_[index];
+            current = ptr(prev->load(std::memory_order_acquire));
+            auto restart = false;
+            while (current != nullptr) {
+                const auto next = current->next.load(std::memory_order_acquire);
+                if (marked(next)) {
+                    auto expected = std::uintptr_t(current);
+                    if (!prev->compare_exchange_strong(expected, next & ~std::uintptr_t(1), std::memory_order_acq_rel)) {
+                        restart = true;
+                        break;
+                    }
+                    epoch().retire(current);
+                    current = ptr(next);
+                    continue;
+                }
+
+                if (key != nullptr && current->key == *key) return true;
+                prev = &current->next;
+                current = ptr(next);
+            }
+            if (!restart) return false;
+        }
+    }
+};
+
+// Split-ordered list (Shalev and Shavit). All entries live in one lock-free
+// list sorted by bit reversed hash, and buckets are lazily inserted dummy
+// nodes into that list, so doubling the bucket count never moves entries.
+template <typename K, typename V>
+class hashmap_t final {
+public:
+    hashmap_t() {
+        segments_[0].store(new std::atomic<link *>[first_segment](), std::memory_order_relaxed);
+        segments_[0].load(std::memory_order_relaxed)[0].store(&head_, std::memory_order_relaxed);
+    }
+
+    hashmap_t(const hashmap_t&) = delete;
+    auto operator=(const hashmap_t&) -> auto& = delete;
+
+    ~hashmap_t() {
+        auto current = ptr(head_.next.load(std::memory_order_acquire));
+        while (current != nullptr) {
+            auto next = ptr(current->next.load(std::memory_order_relaxed));
+            destroy(current);
+            current = next;
+        }
+
+        for (auto& segment : segments_)
+            delete[] segment.load(std::memory_order_relaxed);
+    }
+
+    explicit operator bool() const noexcept {
+        return !empty();
+    }
+
+    auto operator!() const noexcept {
+        return empty();
+    }
+
+    auto empty() const noexcept {
+        return count_.load(std::memory_order_relaxed) == 0;
+    }
+
+    auto size() const noexcept -> std::size_t {
+        return count_.load(std::memory_order_relaxed);
+    }
+
+    auto bucket_count() const noexcept -> std::size_t {
+        return size_.load(std::memory_order_relaxed);
+    }
+
+    auto load_factor() const noexcept {
+        return double(size()) / double(bucket_count());
+    }
+
+    auto insert(const K& key, const V& value) {
+        return emplace(K(key), V(value));
+    }
+
+    auto emplace(K&& key, V&& value) {
+        const epoch_guard guard;
+        const auto hash = hash_of(key);
+        auto made = new entry(regular_key(hash), std::move(key), new V(std::move(value)));
+        if (insert_node(bucket(hash), made, &made->key) != made) {
+            destroy(made);
+            return false;
+        }
+        grow();
+        return true;
+    }
+
+    auto insert_or_assign(const K& key, const V& value) {
+        const epoch_guard guard;
+        const auto hash = hash_of(key);
+        auto made = new entry(regular_key(hash), K(key), new V(value));
+        auto found = insert_node(bucket(hash), made, &key);
+        if (found == made) {
+            grow();
+            return true;
+        }
+
+        epoch().retire(static_cast<entry *>(found)->value.exchange(made->value.exchange(nullptr), std::memory_order_acq_rel));
+        destroy(made);
+        return false;
+    }
+
+    auto find(const K& key) const -> std::optional<V> {
+        const epoch_guard guard;
+        const auto found = lookup(key);
+        if (found == nullptr) return std::nullopt;
+        return *found->value.load(std::memory_order_acquire);
+    }
+
+    auto contains(const K& key) const {
+        const epoch_guard guard;
+        return lookup(key) != nullptr;
+    }
+
+    auto at(const K& key) const -> V {
+        const epoch_guard guard;
+        const auto found = lookup(key);
+        if (found == nullptr) throw range("Key not in hashmap");
+        return *found->value.load(std::memory_order_acquire);
+    }
+
+    auto remove(const K& key) {
+        const epoch_guard guard;
+        const auto hash = hash_of(key);
+        const auto so = regular_key(hash);
+        auto start = bucket(hash);
+        std::atomic<std::uintptr_t> *prev{nullptr};
+        link *current{nullptr};
+        for (;;) {
+            if (!search(start, so, &key, prev, current)) return false;
+            auto next = current->next.load(std::memory_order_acquire);
+            if (marked(next)) continue;
+            if (!current->next.compare_exchange_strong(next, next | 1U, std::memory_order_acq_rel)) continue;
+            count_.fetch_sub(1, std::memory_order_relaxed);
+            auto expected = std::uintptr_t(current);
+            if (prev->compare_exchange_strong(expected, next, std::memory_order_acq_rel))
+                retire(current);
+            else
+                search(start, so, &key, prev, current);
+            return true;
+        }
+    }
+
+    void clear() {
+        const epoch_guard guard;
+        auto current = ptr(head_.next.load(std::memory_order_acquire));
+        while (current != nullptr) {
+            auto next = current->next.load(std::memory_order_acquire);
+            if (!dummy(current) && !marked(next) && current->next.compare_exchange_strong(next, next | 1U, std::memory_order_acq_rel))
+                count_.fetch_sub(1, std::memory_order_relaxed);
+            current = ptr(next);
+        }
+
+        std::atomic<std::uintptr_t> *prev{nullptr};
+        search(&head_, ~std::uint64_t(0), nullptr, prev, current);
+    }
+
+    auto keys() const {
+        std::vector<K> list;
+        list.reserve(size());
+        each([&list](const K& key, const V&) {
+            list.push_back(key);
+        });
+        return list;
+    }
+
+    template <typename Func>
+    void each(Func func) const {
+        const epoch_guard guard;
+        auto current = ptr(head_.next.load(std::memory_order_acquire));
+        while (current != nullptr) {
+            const auto next = current->next.load(std::memory_order_acquire);
+            if (!dummy(current) && !marked(next)) {
+                auto item = static_cast<const entry *>(current);
+                func(item->key, *item->value.load(std::memory_order_acquire));
+            }
+            current = ptr(next);
+        }
+    }
+
+private:
+    struct link {
+        const std::uint64_t so{0};
+        std::atomic<std::uintptr_t> next{0};
+
+        explicit link(std::uint64_t key) noexcept : so(key) {}
+    };
+
+    struct entry final : link {
+        const K key;
+        std::atomic<V *> value{nullptr};
+
+        entry(std::uint64_t so, K&& k, V *v) : link(so), key(std::move(k)), value(v) {}
+        ~entry() { delete value.load(std::memory_order_relaxed); }
+    };
+
+    static constexpr std::size_t first_segment = 64;
+    static constexpr std::size_t max_segments = 48;
+    static constexpr std::size_t max_load = 2;
+
+    link head_{0};
+    mutable std::atomic<std::atomic<link *> *> segments_[max_segments]{};
+    alignas(cache_line) std::atomic<std::size_t> size_{first_segment};
+    alignas(cache_line) std::atomic<std::size_t> count_{0};
+
+    static auto ptr(std::uintptr_t next) noexcept {
+        return reinterpret_cast<link *>(next & ~std::uintptr_t(1));
+    }
+
+    static constexpr auto marked(std::uintptr_t next) noexcept {
+        return (next & 1U) != 0;
+    }
+
+    static constexpr auto dummy(const link *node) noexcept {
+        return (node->so & 1U) == 0;
+    }
+
+    static auto hash_of(const K& key) noexcept {
+        return detail::mix_hash(std::hash<K>()(key));
+    }
+
+    static constexpr auto regular_key(std::uint64_t hash) noexcept {
+        return detail::reverse_bits(hash) | 1U;
+    }
+
+    static void destroy(link *node) noexcept {
+        if (dummy(node))
+            delete node;
+        else
+            delete static_cast<entry *>(node);
+    }
+
+    static void retire(link *node) {
+        epoch().retire(node, [](void *ptr) { destroy(static_cast<link *>(ptr)); });
+    }
+
+    void grow() noexcept {
+        const auto count = count_.fetch_add(1, std::memory_order_relaxed) + 1;
+        auto size = size_.load(std::memory_order_relaxed);
+        if (count > size * max_load && size < (first_segment << (max_segments - 1)))
+            size_.compare_exchange_strong(size, size * 2, std::memory_order_relaxed);
+    }
+
+    auto slot(std::size_t index) const -> std::atomic<link *>& {
+        std::size_t segment = 0, offset = index;
+        if (index >= first_segment) {
+            const auto high = detail::log2_floor(index);
+            segment = high - detail::log2_floor(first_segment) + 1;
+            offset = index - (std::size_t(1) << high);
+        }
+
+        auto table = segments_[segment].load(std::memory_order_acquire);
+        if (table == nullptr) {
+            const auto count = segment ? first_segment << (segment - 1) : first_segment;
+            auto made = new std::atomic<link *>[count]();
+            if (segments_[segment].compare_exchange_strong(table, made, std::memory_order_acq_rel))
+                table = made;
+            else
+                delete[] made;
+        }
+        return table[offset];
+    }
+
+    auto bucket(std::uint64_t hash) const -> link * {
+        const auto index = std::size_t(hash & (size_.load(std::memory_order_acquire) - 1));
+        return bucket_at(index);
+    }
+
+    auto bucket_at(std::size_t index) const -> link * {
+        auto& cell = slot(index);
+        auto node = cell.load(std::memory_order_acquire);
+        if (node != nullptr) return node;
+
+        const auto parent = bucket_at(index & ~(std::size_t(1) << detail::log2_floor(index)));
+        auto made = new link(detail::reverse_bits(index));
+        node = const_cast<hashmap_t *>(this)->insert_node(parent, made, nullptr);
+        if (node != made)
+            delete made;
+        cell.store(node, std::memory_order_release);
+        return node;
+    }
+
+    auto lookup(const K& key) const -> const entry * {
+        const auto hash = hash_of(key);
+        std::atomic<std::uintptr_t> *prev{nullptr};
+        link *current{nullptr};
+        if (!const_cast<hashmap_t *>(this)->search(bucket(hash), regular_key(hash), &key, prev, current)) return nullptr;
+        return static_cast<const entry *>(current);
+    }
+
+    auto insert_node(link *start, link *node, const K *key) -> link * {
+        std::atomic<std::uintptr_t> *prev{nullptr};
+        link *current{nullptr};
+        for (;;) {
+            if (search(start, node->so, key, prev, current)) return current;
+            node->next.store(std::uintptr_t(current), std::memory_order_relaxed);
+            auto expected = std::uintptr_t(current);
+            if (prev->compare_exchange_strong(expected, std::uintptr_t(node), std::memory_order_acq_rel))
+                return node;
+        }
+    }
+
+    // Harris-Michael search; unlinks marked nodes on the way. With no key
+    // only a dummy node of the given split order key will match.
+    auto search(link *start, std::uint64_t so, const K *key, std::atomic<std::uintptr_t> *&prev, link *&current) -> bool {
+        for (;;) {
+            prev = &start->next;
+            current = ptr(prev->load(std::memory_order_acquire));
+            auto restart = false;
+            while (current != nullptr) {
+                const auto next = current->next.load(std::memory_order_acquire);
+                if (marked(next)) {
+                    auto expected = std::uintptr_t(current);
+                    if (!prev->compare_exchange_strong(expected, next & ~std::uintptr_t(1), std::memory_order_acq_rel)) {
+                        restart = true;
+                        break;
+                    }
+                    retire(current);
+                    current = ptr(next);
+                    continue;
+                }
+
+                if (current->so > so) return false;
+                if (current->so == so) {
+                    if (key == nullptr && dummy(current)) return true;
+                    if (key != nullptr && static_cast<const entry *>(current)->key == *key) return true;
+                }
+                prev = &current->next;
+                current = ptr(next);
+            }
+            if (!restart) return false;
+        }
+    }
+};
+
+// Lockfree ordered map, a Fraser / Herlihy-Shavit skip list with a marked
+// link per level. A key is present once linked at level zero and removed
+// once its level zero link is marked. The inserter and the remover each
+// hold a reference to a node, and it is retired to the epoch domain only
+// when both are done, so a late upper level link never outlives the node.
+template <typename K, typename V, typename Compare = std::less<K>>
+class skiplist_t final {
+    struct node;
+
+public:
+    // a guarded view of [lo, hi); nodes stay valid while the range lives
+    class range_t final {
+    public:
+        class iterator final {
+        public:
+            using iterator_category = std::forward_iterator_tag;
+            using value_type = std::pair<const K&, const V&>;
+            using difference_type = std::ptrdiff_t;
+            using pointer = void;
+            using reference = value_type;
+
+            auto operator*() const -> value_type {
+                return {node_->key, node_->value};
+            }
+
+            auto operator++() -> iterator& {
+                node_ = live(ptr(node_->next(0).load(std::memory_order_acquire)));
+                if (node_ && hi_ && !less(node_->key, *hi_)) node_ = nullptr;
+                return *this;
+            }
+
+            auto operator==(const iterator& other) const noexcept {
+                return node_ == other.node_;
+            }
+
+            auto operator!=(const iterator& other) const noexcept {
+                return node_ != other.node_;
+            }
+
+        private:
+            friend class range_t;
+
+            const node *node_{nullptr};
+            const K *hi_{nullptr};
+
+            iterator(const node *current, const K *hi) noexcept : node_(current), hi_(hi) {}
+        };
+
+        range_t(const range_t&) = delete;
+        auto operator=(const range_t&) -> auto& = delete;
+
+        auto begin() const noexcept {
+            return iterator(first_, hi_ ? &*hi_ : nullptr);
+        }
+
+        auto end() const noexcept {
+            return iterator(nullptr, nullptr);
+        }
+
+        auto empty() const noexcept {
+            return first_ == nullptr;
+        }
+
+    private:
+        friend class skiplist_t;
+
+        const epoch_guard guard_;
+        const std::optional<K> hi_;
+        const node *first_{nullptr};
+
+        range_t(const skiplist_t *list, const K *lo, std::optional<K> hi) : hi_(std::move(hi)) {
+            first_ = lo ? list->first_from(*lo) : live(ptr(list->head_[0].load(std::memory_order_acquire)));
+            if (first_ && hi_ && !less(first_->key, *hi_)) first_ = nullptr;
+        }
+    };
 
-    mutable std::atomic<T> seq_{0};
-};
+    skiplist_t() = default;
+    skiplist_t(const skiplist_t&) = delete;
+    auto operator=(const skiplist_t&) -> auto& = delete;
 
-class once_t final {
-public:
-    once_t() = default;
-    once_t(const once_t&) = delete;
-    auto operator=(const once_t&) = delete;
+    ~skiplist_t() {
+        auto current = ptr(head_[0].load(std::memory_order_acquire));
+        while (current != nullptr) {
+            auto next = ptr(current->next(0).load(std::memory_order_relaxed));
+            destroy(current);
+            current = next;
+        }
+    }
 
     explicit operator bool() const noexcept {
-        return flag_.exchange(false);
+        return !empty();
     }
 
     auto operator!() const noexcept {
-        return !flag_.exchange(false);
+        return empty();
     }
 
-    void reset() noexcept {
-        flag_.store(true, std::memory_order_release);
+    auto empty() const noexcept {
+        return count_.load(std::memory_order_relaxed) == 0;
     }
 
-private:
-    mutable std::atomic<bool> flag_{true};
-};
+    auto size() const noexcept -> std::size_t {
+        return count_.load(std::memory_order_relaxed);
+    }
 
-template <typename T, std::size_t S>
-class stack_t final {
-public:
-    stack_t() = default;
-    stack_t(const stack_t&) = delete;
-    auto operator=(const stack_t&) -> auto& = delete;
+    auto insert(const K& key, const V& value) {
+        const epoch_guard guard;
+        node *preds[max_level], *succs[max_level];
+        const auto height = random_height();
+        node *made = nullptr;
+        for (;;) {
+            if (search(key, preds, succs)) {
+                if (made) destroy(made);
+                return false;
+            }
 
-    explicit operator bool() const noexcept {
-        return count_.load() > 0;
-    }
+            if (!made) made = create(key, value, height);
+            for (unsigned level = 0; level < height; ++level)
+                made->next(level).store(std::uintptr_t(succs[level]), std::memory_order_relaxed);
+            auto expected = std::uintptr_t(succs[0]);
+            if (link(preds[0], 0).compare_exchange_strong(expected, std::uintptr_t(made), std::memory_order_acq_rel)) break;
+        }
 
-    auto operator!() const noexcept {
-        return count_.load() < 1;
+        count_.fetch_add(1, std::memory_order_relaxed);
+        link_levels(made, preds, succs);
+        if (marked(made->next(0).load()))
+            search(made->key, preds, succs);
+        release(made);
+        return true;
     }
 
-    auto operator*() noexcept {
-        return pop();
+    auto erase(const K& key) {
+        const epoch_guard guard;
+        node *preds[max_level], *succs[max_level];
+        if (!search(key, preds, succs)) return false;
+        return remove_node(succs[0], preds, succs);
     }
 
-    auto operator<=(const T& item) {
-        return push(item);
+    auto find(const K& key) const -> std::optional<V> {
+        const epoch_guard guard;
+        auto found = first_from(key);
+        if (!found || less(key, found->key)) return std::nullopt;
+        return found->value;
     }
 
-    auto size() const noexcept -> std::size_t {
-        auto count = count_.load();
-        if (count < 0) return std::size_t(0);
-        if (count > S) return S;
-        return count;
+    auto contains(const K& key) const {
+        const epoch_guard guard;
+        auto found = first_from(key);
+        return found && !less(key, found->key);
+    }
+
+    // first entry not less than key
+    auto lower_bound(const K& key) const -> std::optional<std::pair<K, V>> {
+        const epoch_guard guard;
+        auto found = first_from(key);
+        if (!found) return std::nullopt;
+        return std::pair<K, V>(found->key, found->value);
+    }
+
+    auto pop_min() -> std::optional<std::pair<K, V>> {
+        const epoch_guard guard;
+        node *preds[max_level], *succs[max_level];
+        for (;;) {
+            auto current = live(ptr(head_[0].load(std::memory_order_acquire)));
+            if (!current) return std::nullopt;
+            if (remove_node(current, preds, succs))
+                return std::pair<K, V>(current->key, current->value);
+        }
     }
 
-    auto empty() const noexcept {
-        return count_.load() < 1;
+    void clear() {
+        while (pop_min()) {}
     }
 
-    auto full() const noexcept {
-        return count_.load() >= S;
+    auto range(const K& lo, const K& hi) const {
+        return range_t(this, &lo, hi);
     }
 
-    auto push(const T& item) noexcept {
-        const auto count = count_.fetch_add(1);
-        if (count >= S) {
-            count_.fetch_sub(1);
-            return false;
-        }
-        data_[count] = item;
-        return true;
+    auto range_from(const K& lo) const {
+        return range_t(this, &lo, std::nullopt);
     }
 
-    auto pull(T& item) noexcept {
-        const auto count = count_.fetch_sub(1);
-        if (count < 0) {
-            count_.fetch_add(1);
-            return false;
-        }
-        item = data_[count];
-        return true;
+    auto range() const {
+        return range_t(this, nullptr, std::nullopt);
     }
 
-    auto pop() noexcept -> std::optional<T> {
-        const auto count = count_.fetch_sub(1);
-        if (count < 0) {
-            count_.fetch_add(1);
-            return {};
-        }
-        return data_[count];
+    template <typename Func>
+    void each(Func func) const {
+        for (const auto& [key, value] : range())
+            func(key, value);
     }
 
 private:
-    static_assert(S > 2, "Queue size must be bigger than 2");
+    static constexpr unsigned max_level = 16;
 
-    std::atomic<int> count_{0};
-    T data_[S];
-};
+    struct alignas(std::atomic<std::uintptr_t>) node {
+        const K key;
+        const V value;
+        const unsigned height;
+        std::atomic<unsigned> refs{2};
 
-template <typename T, std::size_t S>
-class buffer_t final {
-public:
-    buffer_t() = default;
-    buffer_t(const buffer_t&) = delete;
-    auto operator=(const buffer_t&) -> auto& = delete;
+        node(const K& k, const V& v, unsigned h) : key(k), value(v), height(h) {}
 
-    explicit operator bool() const noexcept {
-        const auto head = head_.load(std::memory_order_relaxed);
-        const auto tail = tail_.load(std::memory_order_relaxed);
-        return head != tail;
-    }
+        // links are laid out directly after the node
+        auto next(unsigned level) const noexcept -> std::atomic<std::uintptr_t>& {
+            return const_cast<std::atomic<std::uintptr_t> *>(reinterpret_cast<const std::atomic<std::uintptr_t> *>(this + 1))[level];
+        }
+    };
 
-    auto operator!() const noexcept {
-        const auto head = head_.load(std::memory_order_relaxed);
-        const auto tail = tail_.load(std::memory_order_relaxed);
-        return head == tail;
-    }
+    mutable std::atomic<std::uintptr_t> head_[max_level]{};
+    alignas(cache_line) std::atomic<std::size_t> count_{0};
 
-    auto operator*() noexcept {
-        return pop();
+    static auto less(const K& lhs, const K& rhs) {
+        return Compare()(lhs, rhs);
     }
 
-    auto operator<=(const T& item) noexcept {
-        return push(item);
+    static auto ptr(std::uintptr_t next) noexcept {
+        return reinterpret_cast<node *>(next & ~std::uintptr_t(1));
     }
 
-    auto empty() const noexcept {
-        return head_.load(std::memory_order_relaxed) == tail_.load(std::memory_order_relaxed);
+    static constexpr auto marked(std::uintptr_t next) noexcept {
+        return (next & 1U) != 0;
     }
 
-    auto full() noexcept {
-        const auto tail = tail_.load(std::memory_order_relaxed);
-        auto next = tail;
-        if (++next >= S)
-            next -= S;
-
-        return next == head_.load(std::memory_order_acquire);
+    // skip over nodes already removed at level zero
+    static auto live(node *current) noexcept -> node * {
+        while (current && marked(current->next(0).load(std::memory_order_acquire)))
+            current = ptr(current->next(0).load(std::memory_order_acquire));
+        return current;
     }
 
-    auto push(const T& item) noexcept {
-        const auto tail = tail_.load(std::memory_order_relaxed);
-        auto next = tail;
-        if (++next >= S)
-            next -= S;
-
-        const auto head = head_.load(std::memory_order_acquire);
-        if (next == head) return false;
-        data_[tail] = item;
-        tail_.store(next, std::memory_order_release);
-        return true;
+    static auto random_height() noexcept {
+        thread_local std::uint64_t state = detail::mix_hash(detail::worker_id() + 1) | 1U;
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        auto height = 1U;
+        for (auto bits = state; height < max_level && (bits & 3U) == 0; bits >>= 2)
+            ++height;
+        return height;
     }
 
-    auto pull(T& item) noexcept {
-        auto head = head_.load(std::memory_order_relaxed);
-        const auto tail = tail_.load(std::memory_order_acquire);
-        if (head == tail) return false;
-        item = data_[head];
-        if (++head >= S)
-            head -= S;
-
-        tail_.store(tail, std::memory_order_release);
-        return true;
+    static auto create(const K& key, const V& value, unsigned height) -> node * {
+        auto mem = ::operator new(sizeof(node) + height * sizeof(std::atomic<std::uintptr_t>));
+        node *made = nullptr;
+        try {
+            made = ::new (mem) node(key, value, height);
+        } catch (...) {
+            ::operator delete(mem);
+            throw;
+        }
+        for (unsigned level = 0; level < height; ++level)
+            ::new (static_cast<void *>(&made->next(level))) std::atomic<std::uintptr_t>(0);
+        return made;
     }
 
-    auto pop() noexcept -> std::optional<T> {
-        auto head = head_.load(std::memory_order_relaxed);
-        const auto tail = tail_.load(std::memory_order_acquire);
-        if (head == tail) return {};
-        auto item = data_[head];
-        if (++head >= S)
-            head -= S;
-
-        tail_.store(tail, std::memory_order_release);
-        return head;
+    static void destroy(node *current) noexcept {
+        current->~node();
+        ::operator delete(static_cast<void *>(current));
     }
 
-private:
-    static_assert(S > 2, "Queue size must be bigger than 2");
+    static void release(node *current) {
+        if (current->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            epoch().retire(current, [](void *ptr) { destroy(static_cast<node *>(ptr)); });
+    }
 
-    std::atomic<unsigned> head_{0U}, tail_{0U};
-    T data_[S];
-};
+    auto link(node *pred, unsigned level) const noexcept -> std::atomic<std::uintptr_t>& {
+        return pred ? pred->next(level) : head_[level];
+    }
 
-template <typename K, typename V, std::size_t S = 16>
-class dictionary_t {
-public:
-    dictionary_t(const dictionary_t&) = delete;
-    auto operator=(const dictionary_t&) -> auto& = delete;
+    auto first_from(const K& key) const -> node * {
+        node *preds[max_level], *succs[max_level];
+        const_cast<skiplist_t *>(this)->search(key, preds, succs);
+        return live(succs[0]);
+    }
 
-    dictionary_t() {
-        for (auto& bucket : table_) {
-            bucket.store(nullptr);
+    // link the upper levels of a new node, stopping if it gets removed
+    void link_levels(node *made, node **preds, node **succs) {
+        for (unsigned level = 1; level < made->height; ++level) {
+            for (;;) {
+                auto next = made->next(level).load(std::memory_order_acquire);
+                if (marked(next)) return;
+                if (ptr(next) != succs[level] && !made->next(level).compare_exchange_strong(next, std::uintptr_t(succs[level]), std::memory_order_acq_rel)) return;
+                auto expected = std::uintptr_t(succs[level]);
+                if (link(preds[level], level).compare_exchange_strong(expected, std::uintptr_t(made), std::memory_order_acq_rel)) break;
+                if (!search(made->key, preds, succs) || succs[0] != made) return;
+            }
         }
     }
 
-    dictionary_t(dictionary_t&& other) noexcept : table_(std::move(other.table_)), count_(other.count_.load()) {
-        for (auto& bucket : table_) {
-            bucket.store(nullptr);
+    auto remove_node(node *victim, node **preds, node **succs) -> bool {
+        for (auto level = victim->height - 1; level >= 1; --level) {
+            auto next = victim->next(level).load(std::memory_order_acquire);
+            while (!marked(next) && !victim->next(level).compare_exchange_weak(next, next | 1U, std::memory_order_acq_rel)) {}
         }
-        other.count_.store(0);
+
+        auto next = victim->next(0).load(std::memory_order_acquire);
+        do { // NOLINT
+            if (marked(next)) return false;
+        } while (!victim->next(0).compare_exchange_weak(next, next | 1U, std::memory_order_acq_rel));
+        count_.fetch_sub(1, std::memory_order_relaxed);
+        search(victim->key, preds, succs);
+        release(victim);
+        return true;
     }
 
-    auto operator=(dictionary_t&& other) noexcept -> auto& {
-        if (this != &other) {
-            clear();
-            table_ = std::move(other.table_);
-            count_.store(other.count_.load());
-            other.count_.store(0);
-            for (auto& bucket : table_) {
-                bucket.store(nullptr);
+    // finds the predecessors and successors of key at every level, and
+    // unlinks marked nodes on the way.
+    auto search(const K& key, node **preds, node **succs) -> bool {
+        for (;;) {
+            node *pred = nullptr, *current = nullptr;
+            auto restart = false;
+            for (auto level = int(max_level) - 1; level >= 0 && !restart; --level) {
+                current = ptr(link(pred, level).load(std::memory_order_acquire));
+                while (current != nullptr) {
+                    const auto next = current->next(level).load(std::memory_order_acquire);
+                    if (marked(next)) {
+                        auto expected = std::uintptr_t(current);
+                        if (!link(pred, level).compare_exchange_strong(expected, next & ~std::uintptr_t(1), std::memory_order_acq_rel)) {
+                            restart = true;
+                            break;
+                        }
+                        current = ptr(next);
+                        continue;
+                    }
+                    if (!less(current->key, key)) break;
+                    pred = current;
+                    current = ptr(next);
+                }
+                preds[level] = pred;
+                succs[level] = current;
             }
+            if (!restart) return current != nullptr && !less(key, current->key);
         }
-        return *this;
+    }
+};
+
+// Open addressed flat table of trivially copyable keys and values. Control
+// bytes are probed a group of 16 at a time. Each group is a seqlock; readers
+// never write shared memory, and writers lock only the groups they change.
+// A writer never waits on a second group while holding its first; it backs
+// off and retries instead, so writers cannot deadlock. Once removals leave
+// tombstones in a quarter of the slots, the table is rebuilt in place so
+// misses stop at an empty byte again.
+template <typename K, typename V>
+class flatmap_t final {
+public:
+    explicit flatmap_t(std::size_t capacity) : mask_(group_count(capacity) - 1), groups_(new group_t[mask_ + 1]), slots_(new cell_t[(mask_ + 1) * group_size]) {
+        for (std::size_t index = 0; index <= mask_; ++index)
+            fill_control(groups_[index], empty_ctrl);
     }
 
+    flatmap_t(const flatmap_t&) = delete;
+    auto operator=(const flatmap_t&) -> auto& = delete;
+
     explicit operator bool() const noexcept {
-        return count_.load() > 0;
+        return !empty();
     }
 
     auto operator!() const noexcept {
-        return count_.load() == 0;
+        return empty();
+    }
+
+    auto empty() const noexcept {
+        return count_.load(std::memory_order_relaxed) == 0;
     }
 
-    auto operator[](const K& key) const -> const V& {
-        at(key);
+    auto size() const noexcept -> std::size_t {
+        return count_.load(std::memory_order_relaxed);
     }
 
-    auto operator[](const K& key) -> V& {
-        at(key);
+    auto capacity() const noexcept {
+        return (mask_ + 1) * group_size;
     }
 
-    void clear() {
-        for (auto& bucket : table_) {
-            auto current = bucket.exchange(nullptr);
-            while (current != nullptr) {
-                auto next = current->next.load();
-                delete current;
-                current = next;
+    // a rebuild moves keys between groups, so a probe that overlapped one
+    // is repeated
+    auto find(const K& key) const -> std::optional<V> {
+        const auto hash = hash_of(key);
+        for (;;) {
+            const auto layout = layout_.load(std::memory_order_acquire);
+            if (layout & 1U) {
+                detail::spin_pause();
+                continue;
             }
+
+            std::size_t index{0}, pos{0};
+            V value{};
+            const auto probe = locate(key, hash, unlocked, index, pos, &value);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (layout_.load(std::memory_order_relaxed) != layout) continue;
+            if (probe != probe_t::found) return std::nullopt;
+            return value;
         }
-        count_.store(0, std::memory_order_relaxed);
     }
 
-    auto insert(const K& key, const V& value) {
-        auto index = key_index(key);
-        auto made = new node(key, value);
-        node *expected = nullptr;
-
-        do { // NOLINT
-            expected = table_[index].load();
-            made->next.store(expected);
-        } while (!table_[index].compare_exchange_weak(expected, made));
+    auto contains(const K& key) const {
+        return find(key).has_value();
+    }
 
-        count_.fetch_add(1, std::memory_order_relaxed);
-        return true;
+    // false if the key is already present; a full table throws as it does
+    // for insert_or_assign
+    auto insert(const K& key, const V& value) {
+        const auto result = store(key, value, false);
+        if (result < 0) throw overflow("Flatmap full");
+        return result > 0;
     }
 
     auto insert_or_assign(const K& key, const V& value) {
-        auto index = key_index(key);
-        auto made = new node(key, value);
-        auto current = table_[index].load();
+        const auto result = store(key, value, true);
+        if (result < 0) throw overflow("Flatmap full");
+        return result > 0;
+    }
 
-        while (current != nullptr) {
-            if (current->key == key) {
-                current->value = value;
-                delete made;
-                return true;
+    auto remove(const K& key) {
+        const auto hash = hash_of(key);
+        const auto first = home(hash);
+        for (;;) {
+            lock(first);
+            std::size_t index{0}, pos{0};
+            const auto probe = locate(key, hash, first, index, pos);
+            if (probe == probe_t::absent) {
+                unlock(first);
+                return false;
             }
-            current = current->next.load();
+
+            if (probe == probe_t::busy || (index != first && !try_lock(index))) {
+                unlock(first);
+                detail::spin_pause();
+                continue;
+            }
+
+            auto& group = groups_[index];
+            const auto tombstone = !detail::match_group(control(group).bytes, empty_ctrl);
+            set_control(group, pos, tombstone ? deleted_ctrl : empty_ctrl);
+            count_.fetch_sub(1, std::memory_order_relaxed);
+            if (index != first)
+                unlock(index);
+            unlock(first);
+            if (tombstone && deleted_.fetch_add(1, std::memory_order_relaxed) + 1 > capacity() / 4)
+                compact();
+            return true;
         }
+    }
 
-        delete made;
-        insert(key, value);
-        return true;
+    void clear() noexcept {
+        for (std::size_t index = 0; index <= mask_; ++index) {
+            lock(index);
+            fill_control(groups_[index], empty_ctrl);
+            unlock(index);
+        }
+        count_.store(0, std::memory_order_relaxed);
+        deleted_.store(0, std::memory_order_relaxed);
     }
 
-    auto emplace(K&& key, V&& value) {
-        auto index = key_index(key);
-        auto made = new node(std::move(key), std::move(value));
-        node *expected = nullptr;
+private:
+    static_assert(std::is_trivially_copyable_v<K> && std::is_trivially_copyable_v<V>, "K and V must be trivially copyable");
+    static_assert(std::is_default_constructible_v<K> && std::is_default_constructible_v<V>, "K and V must be default constructible");
+
+    static constexpr std::size_t group_size = 16;
+    static constexpr std::int8_t empty_ctrl = -128;
+    static constexpr std::int8_t deleted_ctrl = -2;
+    static constexpr auto unlocked = ~std::size_t(0);
+
+    enum class probe_t { absent, found, busy };
+
+    // control bytes and slots are kept in relaxed atomic words, as for
+    // lock::seqlock, so an optimistic read that races a writer is a retry
+    // rather than a data race
+    struct alignas(cache_line) group_t {
+        std::atomic<std::uint32_t> version{0};
+        std::atomic<std::uint64_t> ctrl[group_size / 8]{};
+    };
 
-        do { // NOLINT
-            expected = table_[index].load();
-            made->next.store(expected);
-        } while (!table_[index].compare_exchange_weak(expected, made));
+    struct alignas(16) control_t {
+        std::int8_t bytes[group_size];
+    };
 
-        count_.fetch_add(1, std::memory_order_relaxed);
-        return true;
-    }
+    struct slot_t {
+        K key{};
+        V value{};
+    };
 
-    auto try_emplace(K&& key, V&& value) {
-        auto index = key_index(key);
-        auto made = new node(std::move(key), std::move(value));
-        auto current = table_[index].load();
+    static constexpr std::size_t slot_words = (sizeof(slot_t) + sizeof(std::uint64_t) - 1) / sizeof(std::uint64_t);
 
-        while (current != nullptr) {
-            if (current->key == key) {
-                delete made;
-                return false;
-            }
-            current = current->next.load();
-        }
+    struct cell_t {
+        std::atomic<std::uint64_t> words[slot_words]{};
+    };
 
-        emplace(std::move(made->key), std::move(made->value));
-        delete made;
-        return true;
+    const std::size_t mask_;
+    std::unique_ptr<group_t[]> groups_;
+    std::unique_ptr<cell_t[]> slots_;
+    alignas(cache_line) std::atomic<std::size_t> count_{0};
+    std::atomic<std::size_t> deleted_{0};
+    std::atomic<std::uint32_t> layout_{0}; // odd while rebuilding
+    std::atomic<bool> compacting_{false};
+
+    static auto group_count(std::size_t capacity) noexcept -> std::size_t {
+        const auto needed = (capacity + capacity / 7 + group_size - 1) / group_size;
+        std::size_t count = 1;
+        while (count < needed)
+            count <<= 1;
+        return count;
     }
 
-    auto find(const K& key) const -> std::optional<V> {
-        auto index = key_index(key);
-        auto current = table_[index].load();
-        while (current != nullptr) {
-            if (current->key == key) return current->value;
-            current = current->next.load();
-        }
-        return std::nullopt;
+    static auto hash_of(const K& key) noexcept {
+        return detail::mix_hash(std::hash<K>()(key));
     }
 
-    auto contains(const K& key) const {
-        auto index = key_index(key);
-        auto current = table_[index].load();
-
-        while (current != nullptr) {
-            if (current->key == key) return true;
-            current = current->next.load();
-        }
-        return false;
+    static constexpr auto tag(std::uint64_t hash) noexcept {
+        return std::int8_t(hash & 0x7f);
     }
 
-    auto at(const K& key) const -> const V& {
-        auto index = key_index(key);
-        auto current = table_[index].load();
-        while (current != nullptr) {
-            if (current->key == key) return current->value;
-            current = current->next.load();
-        }
-        throw range("Key not in dictionary");
+    auto home(std::uint64_t hash) const noexcept -> std::size_t {
+        return std::size_t(hash >> 7) & mask_;
     }
 
-    auto at(const K& key) -> V& {
-        auto index = key_index(key);
-        auto current = table_[index].load();
-        while (current != nullptr) {
-            if (current->key == key) return current->value;
-            current = current->next.load();
-        }
-        throw range("Key not in dictionary");
+    void lock(std::size_t index) noexcept {
+        while (!try_lock(index))
+            detail::spin_pause();
     }
 
-    auto remove(const K& key) {
-        auto index = key_index(key);
-        auto current = table_[index].load();
-        node *prev = nullptr;
+    auto try_lock(std::size_t index) noexcept -> bool {
+        auto& version = groups_[index].version;
+        auto current = version.load(std::memory_order_relaxed);
+        if ((current & 1U) || !version.compare_exchange_strong(current, current + 1, std::memory_order_acquire, std::memory_order_relaxed)) return false;
+        std::atomic_thread_fence(std::memory_order_release); // odd version before slot stores
+        return true;
+    }
 
-        while (current != nullptr) {
-            if (current->key == key) {
-                auto next = current->next.load();
-                if (prev != nullptr)
-                    prev->next.store(next);
-                else
-                    table_[index].store(next);
-                delete current;
-                count_.fetch_sub(1, std::memory_order_relaxed);
-                return true;
+    void unlock(std::size_t index) noexcept {
+        auto& version = groups_[index].version;
+        version.store(version.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    static auto control(const group_t& group) noexcept {
+        std::uint64_t words[group_size / 8];
+        for (std::size_t word = 0; word < group_size / 8; ++word)
+            words[word] = group.ctrl[word].load(std::memory_order_relaxed);
+        control_t ctrl;
+        std::memcpy(ctrl.bytes, words, group_size);
+        return ctrl;
+    }
+
+    // only called with the group locked, so no other writer changes the word
+    static void set_control(group_t& group, std::size_t pos, std::int8_t value) noexcept {
+        auto& word = group.ctrl[pos / 8];
+        std::int8_t bytes[8];
+        const auto current = word.load(std::memory_order_relaxed);
+        std::memcpy(bytes, &current, sizeof(bytes));
+        bytes[pos % 8] = value;
+        std::uint64_t changed{0};
+        std::memcpy(&changed, bytes, sizeof(bytes));
+        word.store(changed, std::memory_order_relaxed);
+    }
+
+    static void fill_control(group_t& group, std::int8_t value) noexcept {
+        std::uint64_t filled{0};
+        std::memset(&filled, value, sizeof(filled));
+        for (auto& word : group.ctrl)
+            word.store(filled, std::memory_order_relaxed);
+    }
+
+    auto read_slot(std::size_t slot) const noexcept {
+        std::uint64_t copy[slot_words];
+        for (std::size_t word = 0; word < slot_words; ++word)
+            copy[word] = slots_[slot].words[word].load(std::memory_order_relaxed);
+        slot_t item;
+        std::memcpy(static_cast<void *>(&item), copy, sizeof(slot_t));
+        return item;
+    }
+
+    void write_slot(std::size_t slot, const slot_t& item) noexcept {
+        std::uint64_t copy[slot_words]{};
+        std::memcpy(copy, static_cast<const void *>(&item), sizeof(slot_t));
+        for (std::size_t word = 0; word < slot_words; ++word)
+            slots_[slot].words[word].store(copy[word], std::memory_order_relaxed);
+    }
+
+    // validates every group it reads except the one the caller holds locked.
+    // A writer holding its home group gets busy rather than waiting on
+    // another locked group, and must release its home before trying again.
+    auto locate(const K& key, std::uint64_t hash, std::size_t held, std::size_t& index, std::size_t& pos, V *value = nullptr) const -> probe_t {
+        index = home(hash);
+        for (std::size_t probe = 0; probe <= mask_; ++probe) {
+            const auto& group = groups_[index];
+            for (;;) {
+                const auto version = group.version.load(std::memory_order_acquire);
+                if (index != held && (version & 1U)) {
+                    if (held != unlocked) return probe_t::busy;
+                    detail::spin_pause();
+                    continue;
+                }
+
+                auto found = false;
+                const auto ctrl = control(group);
+                auto match = detail::match_group(ctrl.bytes, tag(hash));
+                const auto open = detail::match_group(ctrl.bytes, empty_ctrl);
+                while (match) {
+                    pos = unsigned(__builtin_ctz(match));
+                    const auto item = read_slot(index * group_size + pos);
+                    if (item.key == key) {
+                        if (value != nullptr)
+                            *value = item.value;
+                        found = true;
+                        break;
+                    }
+                    match &= match - 1;
+                }
+
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (index != held && group.version.load(std::memory_order_relaxed) != version) continue;
+                if (found) return probe_t::found;
+                if (open) return probe_t::absent;
+                break;
             }
-            prev = current;
-            current = current->next.load();
+            index = (index + probe + 1) & mask_;
         }
-        return false;
-    }
+        return probe_t::absent;
+    }
+
+    // 1 if inserted, 0 if found (and assigned), -1 if full
+    auto store(const K& key, const V& value, bool assign) -> int {
+        const auto hash = hash_of(key);
+        const auto first = home(hash);
+        for (;;) {
+            lock(first);
+            std::size_t index{0}, pos{0};
+            const auto probe = locate(key, hash, first, index, pos);
+            if (probe == probe_t::busy) {
+                unlock(first);
+                detail::spin_pause();
+                continue;
+            }
 
-    auto empty() const noexcept {
-        return count_.load() == 0;
-    }
+            const auto found = probe == probe_t::found;
+            if (found && !assign) {
+                unlock(first);
+                return 0;
+            }
 
-    auto size() const noexcept {
-        return count_.load();
-    }
+            if (!found && !vacancy(hash, index, pos)) {
+                unlock(first);
+                return -1;
+            }
 
-    auto keys() const {
-        std::list<K> list;
-        for (auto& bucket : table_) {
-            auto current = bucket.load();
-            while (current != nullptr) {
-                list.push_back(current->key);
-                current = current->next.load();
+            if (index != first && !try_lock(index)) {
+                unlock(first);
+                detail::spin_pause();
+                continue;
             }
-        }
-        return list;
-    }
 
-    template <typename Func>
-    void each(Func func) {
-        for (auto& bucket : table_) {
-            auto current = bucket.load();
-            while (current != nullptr) {
-                func(current->key, current->value);
-                current = current->next.load();
+            auto& group = groups_[index];
+            const auto slot = index * group_size + pos;
+            auto stored = found;
+            if (found)
+                write_slot(slot, slot_t{key, value});
+            else if (control(group).bytes[pos] < 0) {
+                if (control(group).bytes[pos] == deleted_ctrl)
+                    deleted_.fetch_sub(1, std::memory_order_relaxed);
+                write_slot(slot, slot_t{key, value});
+                set_control(group, pos, tag(hash));
+                count_.fetch_add(1, std::memory_order_relaxed);
+                stored = true;
             }
+
+            if (index != first)
+                unlock(index);
+            unlock(first);
+            if (stored) return found ? 0 : 1;
         }
     }
 
-private:
-    struct node {
-        K key;
-        V value;
-        std::atomic<node *> next{nullptr};
+    // rebuilds the table in place with every group locked in index order.
+    // Best effort: skipped if another rebuild is running or the live entries
+    // cannot be copied out.
+    void compact() noexcept {
+        if (compacting_.exchange(true, std::memory_order_acquire)) return;
+        for (std::size_t index = 0; index <= mask_; ++index)
+            lock(index);
+
+        std::vector<slot_t> live;
+        auto rebuild = deleted_.load(std::memory_order_relaxed) > capacity() / 4;
+        try {
+            if (rebuild)
+                live.reserve(count_.load(std::memory_order_relaxed));
+        } catch (...) {
+            rebuild = false;
+        }
 
-        node(const K& k, const V& v) : key(k), value(v) {}
-        node(K&& k, V&& v) : key(std::move(k)), value(std::move(v)) {}
-    };
+        if (rebuild) {
+            layout_.fetch_add(1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            for (std::size_t index = 0; index <= mask_; ++index) {
+                const auto ctrl = control(groups_[index]);
+                for (std::size_t pos = 0; pos < group_size; ++pos) {
+                    if (ctrl.bytes[pos] >= 0)
+                        live.push_back(read_slot(index * group_size + pos));
+                }
+                fill_control(groups_[index], empty_ctrl);
+            }
 
-    std::atomic<node *> table_[S];
-    std::atomic<std::size_t> count_{0};
+            for (const auto& item : live) {
+                const auto hash = hash_of(item.key);
+                std::size_t index{0}, pos{0};
+                vacancy(hash, index, pos);
+                write_slot(index * group_size + pos, item);
+                set_control(groups_[index], pos, tag(hash));
+            }
+            deleted_.store(0, std::memory_order_relaxed);
+            layout_.fetch_add(1, std::memory_order_release);
+        }
 
-    auto key_index(const K& key) const -> std::size_t {
-        return std::hash<K>()(key) % S;
+        for (std::size_t index = 0; index <= mask_; ++index)
+            unlock(index);
+        compacting_.store(false, std::memory_order_release);
+    }
+
+    auto vacancy(std::uint64_t hash, std::size_t& index, std::size_t& pos) const -> bool {
+        index = home(hash);
+        for (std::size_t probe = 0; probe <= mask_; ++probe) {
+            const auto open = detail::match_negative(control(groups_[index]).bytes);
+            if (open) {
+                pos = unsigned(__builtin_ctz(open));
+                return true;
+            }
+            index = (index + probe + 1) & mask_;
+        }
+        return false;
     }
 };
 } // namespace hitycho::atomic
@@ -648,6 +3156,19 @@ public:
 #endif
     }
 
+    // block the calling hpx thread until the value no longer equals old
+    void wait(T old) const {
+        atomic::detail::park(&ref, [this, old] { return load() != old; });
+    }
+
+    void notify_one() const {
+        atomic::detail::unpark(&ref);
+    }
+
+    void notify_all() const {
+        atomic::detail::unpark(&ref);
+    }
+
 private:
     static_assert(std::is_integral_v<T> && (sizeof(T) == 1 || sizeof(T) == 2 || sizeof(T) == 4 || sizeof(T) == 8), "T must be integral of supported size");
 
@@ -0,0 +1,239 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright (C) 2025 David Sugar <tychosoft@gmail.com>
+
+#pragma once
+
+#include "atomic.hpp"
+
+#include <hpx/future.hpp>
+#include <hpx/synchronization/mutex.hpp>
+
+#include <chrono>
+#include <unordered_map>
+
+namespace hitycho::atomic {
+// Sharded CLOCK cache. Lookups go thru the lockfree hashmap of each shard
+// and only set a reference bit, so hits never take a lock. Inserts and
+// eviction are serialized per shard, and evicted entries are retired to the
+// epoch domain so concurrent readers may still copy from them. Capacity and
+// cost are split exactly across the shards, so the totals are never exceeded,
+// but a shard evicts once its own share is used even if others have room. An
+// entry that alone costs more than its shard's share is kept by itself.
+template <typename K, typename V, std::size_t N = 16>
+class cache_t final {
+public:
+    using clock_t = std::chrono::steady_clock;
+
+    explicit cache_t(std::size_t capacity, std::size_t max_cost = 0, clock_t::duration ttl = clock_t::duration::zero()) : ttl_(ttl) {
+        if (capacity < N) throw invalid("Cache capacity must be at least one per shard");
+        if (max_cost && max_cost < N) throw invalid("Cache cost must be at least one per shard");
+        for (std::size_t index = 0; index < N; ++index) {
+            shards_[index].limit = capacity / N + (index < capacity % N);
+            if (max_cost)
+                shards_[index].cost_limit = max_cost / N + (index < max_cost % N);
+        }
+    }
+
+    cache_t(const cache_t&) = delete;
+    auto operator=(const cache_t&) -> auto& = delete;
+
+    ~cache_t() {
+        for (auto& shard : shards_) {
+            for (auto item : shard.clock)
+                delete item;
+        }
+    }
+
+    auto size() const noexcept {
+        std::size_t count = 0;
+        for (const auto& shard : shards_)
+            count += shard.map.size();
+        return count;
+    }
+
+    auto empty() const noexcept {
+        return size() == 0;
+    }
+
+    auto cost() const {
+        std::size_t total = 0;
+        for (auto& shard : shards_) {
+            const guard_t lock(shard.lock);
+            total += shard.cost;
+        }
+        return total;
+    }
+
+    auto contains(const K& key) const {
+        return get(key).has_value();
+    }
+
+    auto get(const K& key) const -> std::optional<V> {
+        const epoch_guard guard;
+        auto found = shard_of(key).map.find(key);
+        if (!found) return std::nullopt;
+        auto item = *found;
+        if (expired(item)) return std::nullopt;
+        if (!item->referenced.load(std::memory_order_relaxed))
+            item->referenced.store(true, std::memory_order_relaxed);
+        return item->value;
+    }
+
+    void put(const K& key, const V& value, std::size_t cost = 1) {
+        auto made = new entry(key, value, cost, expires());
+        auto& shard = shard_of(key);
+        const guard_t lock(shard.lock);
+        const epoch_guard guard;
+        auto found = shard.map.find(key);
+        if (found) {
+            auto prior = *found;
+            made->slot = prior->slot;
+            shard.clock[made->slot] = made;
+            shard.cost = shard.cost + cost - prior->cost;
+            shard.map.insert_or_assign(key, made);
+            epoch().retire(prior);
+        } else {
+            while (!shard.clock.empty() && !fits(shard, cost))
+                evict(shard);
+            made->slot = shard.clock.size();
+            shard.clock.push_back(made);
+            shard.cost += cost;
+            shard.map.insert(key, made);
+        }
+
+        while (shard.clock.size() > 1 && shard.cost_limit && shard.cost > shard.cost_limit)
+            evict(shard, made);
+    }
+
+    auto remove(const K& key) {
+        auto& shard = shard_of(key);
+        const guard_t lock(shard.lock);
+        const epoch_guard guard;
+        auto found = shard.map.find(key);
+        if (!found) return false;
+        release(shard, (*found)->slot);
+        return true;
+    }
+
+    void clear() {
+        for (auto& shard : shards_) {
+            const guard_t lock(shard.lock);
+            while (!shard.clock.empty())
+                release(shard, shard.clock.size() - 1);
+            shard.hand = 0;
+        }
+    }
+
+    // concurrent misses for the same key share a single call to loader
+    template <typename Loader>
+    auto get_or_load(const K& key, Loader loader) -> V {
+        if (auto value = get(key)) return *value;
+        auto& shard = shard_of(key);
+        std::unique_lock<hpx::mutex> lock(shard.lock);
+        if (auto value = get(key)) return *value;
+        auto pending = shard.loading.find(key);
+        if (pending != shard.loading.end()) {
+            auto future = pending->second;
+            lock.unlock();
+            return future.get();
+        }
+
+        hpx::promise<V> promise;
+        shard.loading.emplace(key, promise.get_future().share());
+        lock.unlock();
+        try {
+            auto value = loader(key);
+            put(key, value);
+            lock.lock();
+            shard.loading.erase(key);
+            lock.unlock();
+            promise.set_value(value);
+            return value;
+        } catch (...) {
+            lock.lock();
+            shard.loading.erase(key);
+            lock.unlock();
+            promise.set_exception(std::current_exception());
+            throw;
+        }
+    }
+
+private:
+    using guard_t = std::lock_guard<hpx::mutex>;
+
+    struct entry {
+        const K key;
+        const V value;
+        const std::size_t cost;
+        const clock_t::time_point expires;
+        std::atomic<bool> referenced{false};
+        std::size_t slot{0};
+
+        entry(const K& k, const V& v, std::size_t c, clock_t::time_point t) : key(k), value(v), cost(c), expires(t) {}
+    };
+
+    struct alignas(cache_line) shard_t {
+        hashmap_t<K, entry *> map;
+        mutable hpx::mutex lock;
+        std::vector<entry *> clock;
+        std::size_t hand{0};
+        std::size_t cost{0};
+        std::size_t limit{0};
+        std::size_t cost_limit{0};
+        std::unordered_map<K, hpx::shared_future<V>> loading;
+    };
+
+    const clock_t::duration ttl_;
+    mutable shard_t shards_[N];
+
+    auto shard_of(const K& key) const -> shard_t& {
+        return shards_[detail::mix_hash(std::hash<K>()(key)) % N];
+    }
+
+    auto expires() const {
+        if (ttl_ == clock_t::duration::zero()) return clock_t::time_point::max();
+        return clock_t::now() + ttl_;
+    }
+
+    auto expired(const entry *item) const {
+        return ttl_ != clock_t::duration::zero() && item->expires < clock_t::now();
+    }
+
+    auto fits(const shard_t& shard, std::size_t cost) const {
+        if (shard.clock.size() >= shard.limit) return false;
+        return !shard.cost_limit || shard.cost + cost <= shard.cost_limit;
+    }
+
+    // sweep the clock hand, giving referenced entries a second chance; the
+    // entry just stored is kept, so there must be another to evict
+    void evict(shard_t& shard, const entry *keep = nullptr) {
+        for (;;) {
+            if (shard.hand >= shard.clock.size())
+                shard.hand = 0;
+            auto item = shard.clock[shard.hand];
+            if (item == keep) {
+                ++shard.hand;
+                continue;
+            }
+
+            if (item->referenced.load(std::memory_order_relaxed) && !expired(item)) {
+                item->referenced.store(false, std::memory_order_relaxed);
+                ++shard.hand;
+                continue;
+            }
+            release(shard, shard.hand);
+            return;
+        }
+    }
+
+    void release(shard_t& shard, std::size_t slot) {
+        auto item = shard.clock[slot];
+        shard.map.remove(item->key);
+        shard.cost -= item->cost;
+        shard.clock[slot] = shard.clock.back();
+        shard.clock[slot]->slot = slot;
+        shard.clock.pop_back();
+        epoch().retire(item);
+    }
+};
+} // namespace hitycho::atomic
@@ -19,6 +19,8 @@ using range = std::out_of_range;
 using invalid = std::invalid_argument;
 using overflow = std::overflow_error;
 
+inline constexpr std::size_t cache_line = 64;
+
 template <typename T>
 constexpr auto is(const T& object) {
     return static_cast<bool>(object);
@@ -70,6 +72,30 @@ constexpr auto count(const Range& range, const T& value) noexcept -> std::size_t
     return result;
 }
 
+template <std::size_t S>
+constexpr auto is_pow2() noexcept {
+    return S > 0 && (S & (S - 1)) == 0;
+}
+
+// ring index of a free running position, a mask for power of two sizes
+template <std::size_t S, typename T>
+constexpr auto wrap_index(T pos) noexcept -> T {
+    static_assert(std::is_unsigned_v<T>, "ring positions must be unsigned");
+    if constexpr (is_pow2<S>())
+        return pos & T(S - 1);
+    else
+        return pos % T(S);
+}
+
+// next ring index, without division for sizes that are not a power of two
+template <std::size_t S, typename T>
+constexpr auto next_index(T pos) noexcept -> T {
+    if constexpr (is_pow2<S>())
+        return (pos + 1) & T(S - 1);
+    else
+        return ++pos == T(S) ? T(0) : pos;
+}
+
 template <typename T>
 constexpr auto pow(T base, T exp) {
     static_assert(std::is_integral_v<T>, "pow requires integral types");
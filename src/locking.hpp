@@ -3,11 +3,15 @@
 
 #pragma once
 
-#include "common.hpp"
+#include "atomic.hpp"
 
 #include <hpx/synchronization/mutex.hpp>
 #include <hpx/synchronization/shared_mutex.hpp>
 #include <hpx/future.hpp>
+#include <hpx/thread.hpp>
+
+#include <atomic>
+#include <cstring>
 
 namespace hitycho::lock {
 template <typename T>
@@ -200,4 +204,125 @@ public:
 private:
     U *ptr_{nullptr};
 };
+
+// Sequence locked value for small trivially copyable state. Readers take an
+// optimistic copy and retry if a writer was active, so they never write the
+// shared cache line. The value is kept in atomic words so a torn copy is
+// never a data race, only a retry. Writers serialize on the sequence itself.
+template <typename T>
+class seqlock final {
+public:
+    seqlock() noexcept {
+        store(T{});
+    }
+
+    explicit seqlock(const T& value) noexcept {
+        store(value);
+    }
+
+    seqlock(const seqlock&) = delete;
+    auto operator=(const seqlock&) -> auto& = delete;
+
+    operator T() const noexcept {
+        return load();
+    }
+
+    auto operator=(const T& value) noexcept -> auto& {
+        store(value);
+        return *this;
+    }
+
+    auto load() const noexcept -> T {
+        std::uint64_t copy[count];
+        for (unsigned spins = 0;;) {
+            const auto before = seq_.load(std::memory_order_acquire);
+            if (before & 1U) {
+                backoff(spins);
+                continue;
+            }
+            for (std::size_t word = 0; word < count; ++word)
+                copy[word] = words_[word].load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (seq_.load(std::memory_order_relaxed) == before) break;
+        }
+
+        T value;
+        std::memcpy(&value, copy, sizeof(T));
+        return value;
+    }
+
+    void store(const T& value) noexcept {
+        const auto seq = lock();
+        write(value);
+        seq_.store(seq + 2, std::memory_order_release);
+    }
+
+    // read, change, and publish the value as one writer section. Readers
+    // wait while func runs, so it should be short and must not suspend.
+    template <typename Func>
+    void modify(Func func) {
+        const auto seq = lock();
+        auto value = read();
+        try {
+            func(value);
+        } catch (...) {
+            seq_.store(seq + 2, std::memory_order_release);
+            throw;
+        }
+        write(value);
+        seq_.store(seq + 2, std::memory_order_release);
+    }
+
+    auto version() const noexcept {
+        return seq_.load(std::memory_order_acquire) >> 1;
+    }
+
+private:
+    static_assert(std::is_trivially_copyable_v<T>, "T must be trivially copyable");
+    static_assert(std::is_default_constructible_v<T>, "T must be default constructible");
+
+    static constexpr std::size_t count = (sizeof(T) + sizeof(std::uint64_t) - 1) / sizeof(std::uint64_t);
+
+    static constexpr unsigned spin_limit = 64;
+
+    alignas(cache_line) std::atomic<std::uint64_t> seq_{0};
+    std::atomic<std::uint64_t> words_[count]{};
+
+    // a writer may be descheduled mid write, so readers give way after a while
+    static void backoff(unsigned& spins) noexcept {
+        if (++spins < spin_limit) {
+            atomic::detail::spin_pause();
+            return;
+        }
+        spins = 0;
+        hpx::this_thread::yield();
+    }
+
+    auto lock() noexcept -> std::uint64_t {
+        auto seq = seq_.load(std::memory_order_relaxed);
+        for (;;) {
+            if (!(seq & 1U) && seq_.compare_exchange_weak(seq, seq + 1, std::memory_order_relaxed)) break;
+            hpx::this_thread::yield();
+            seq = seq_.load(std::memory_order_relaxed);
+        }
+        std::atomic_thread_fence(std::memory_order_release);
+        return seq;
+    }
+
+    auto read() const noexcept {
+        std::uint64_t copy[count];
+        for (std::size_t word = 0; word < count; ++word)
+            copy[word] = words_[word].load(std::memory_order_relaxed);
+        T value;
+        std::memcpy(&value, copy, sizeof(T));
+        return value;
+    }
+
+    void write(const T& value) noexcept {
+        std::uint64_t copy[count]{};
+        std::memcpy(copy, &value, sizeof(T));
+        for (std::size_t word = 0; word < count; ++word)
+            words_[word].store(copy[word], std::memory_order_relaxed);
+    }
+};
 } // namespace hitycho::lock
@@ -0,0 +1,172 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright (C) 2025 David Sugar <tychosoft@gmail.com>
+
+#pragma once
+
+#include "atomic.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <memory>
+
+namespace hitycho::metrics {
+// Log linear (HDR style) histogram of unsigned values, typically latencies
+// in nanoseconds. Each power of two range is split into 2^(B-1) equal sub
+// buckets, so recorded values keep a relative precision of 2^(1-B). Counts
+// are sharded per worker and bumped with relaxed atomics, so recording
+// never contends. Values beyond 2^44 are counted in the last bucket. The
+// shards are kept on the heap, as they are far too large for hpx stacks.
+template <unsigned B = 7, std::size_t S = 8>
+class histogram_t final {
+public:
+    histogram_t() = default;
+    histogram_t(const histogram_t&) = delete;
+    auto operator=(const histogram_t&) -> auto& = delete;
+
+    auto operator|=(const histogram_t& other) noexcept -> auto& {
+        merge(other);
+        return *this;
+    }
+
+    void record(std::uint64_t value, std::uint64_t times = 1) noexcept {
+        shards_[atomic::detail::worker_id() % S].counts[index_of(value)].fetch_add(times, std::memory_order_relaxed);
+    }
+
+    template <typename Rep, typename Period>
+    void record(std::chrono::duration<Rep, Period> elapsed) noexcept {
+        const auto nsec = std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+        record(nsec > 0 ? std::uint64_t(nsec) : 0);
+    }
+
+    auto count() const noexcept {
+        std::uint64_t total = 0;
+        for (std::size_t index = 0; index < buckets; ++index)
+            total += count_at(index);
+        return total;
+    }
+
+    auto empty() const noexcept {
+        return count() == 0;
+    }
+
+    auto min() const noexcept -> std::uint64_t {
+        for (std::size_t index = 0; index < buckets; ++index) {
+            if (count_at(index)) return lowest(index);
+        }
+        return 0;
+    }
+
+    auto max() const noexcept -> std::uint64_t {
+        for (auto index = buckets; index > 0; --index) {
+            if (count_at(index - 1)) return highest(index - 1);
+        }
+        return 0;
+    }
+
+    auto mean() const noexcept {
+        std::uint64_t total = 0;
+        double sum = 0.0;
+        for (std::size_t index = 0; index < buckets; ++index) {
+            const auto hits = count_at(index);
+            total += hits;
+            sum += double(hits) * (double(lowest(index)) + double(highest(index))) / 2.0;
+        }
+        return total ? sum / double(total) : 0.0;
+    }
+
+    // highest value equivalent to the given percentile, 0 to 100. Counts
+    // only grow, so a second running pass always reaches the rank.
+    auto percentile(double pct) const noexcept -> std::uint64_t {
+        const auto total = count();
+        if (!total) return 0;
+
+        pct = std::clamp(pct, 0.0, 100.0);
+        const auto rank = std::max<std::uint64_t>(1, std::uint64_t(std::ceil(pct / 100.0 * double(total))));
+        std::uint64_t seen = 0;
+        for (std::size_t index = 0; index < buckets; ++index) {
+            seen += count_at(index);
+            if (seen >= rank) return highest(index);
+        }
+        return max();
+    }
+
+    void merge(const histogram_t& other) noexcept {
+        auto& shard = shards_[atomic::detail::worker_id() % S];
+        for (std::size_t index = 0; index < buckets; ++index) {
+            const auto hits = other.count_at(index);
+            if (hits) shard.counts[index].fetch_add(hits, std::memory_order_relaxed);
+        }
+    }
+
+    void reset() noexcept {
+        for (std::size_t pos = 0; pos < S; ++pos) {
+            for (auto& hits : shards_[pos].counts)
+                hits.store(0, std::memory_order_relaxed);
+        }
+    }
+
+private:
+    static_assert(B >= 2 && B <= 16, "Precision bits must be between 2 and 16");
+
+    static constexpr unsigned max_bits = 44;
+    static constexpr std::uint64_t half = std::uint64_t(1) << (B - 1);
+    static constexpr std::size_t buckets = std::size_t((max_bits - B + 2) * half);
+
+    struct alignas(cache_line) shard_t {
+        std::atomic<std::uint64_t> counts[buckets]{};
+    };
+
+    const std::unique_ptr<shard_t[]> shards_{new shard_t[S]};
+
+    static auto index_of(std::uint64_t value) noexcept -> std::size_t {
+        if (value < 2 * half) return std::size_t(value);
+        const auto shift = std::min(atomic::detail::log2_floor(value), max_bits) - (B - 1);
+        if (shift > max_bits - B) return buckets - 1;
+        return std::size_t(shift * half + (value >> shift));
+    }
+
+    static constexpr auto lowest(std::size_t index) noexcept -> std::uint64_t {
+        if (index < 2 * half) return index;
+        const auto shift = index / half - 1;
+        return (index - shift * half) << shift;
+    }
+
+    static constexpr auto highest(std::size_t index) noexcept -> std::uint64_t {
+        if (index < 2 * half) return index;
+        const auto shift = index / half - 1;
+        return ((index - shift * half + 1) << shift) - 1;
+    }
+
+    auto count_at(std::size_t index) const noexcept {
+        std::uint64_t hits = 0;
+        for (std::size_t pos = 0; pos < S; ++pos)
+            hits += shards_[pos].counts[index].load(std::memory_order_relaxed);
+        return hits;
+    }
+};
+
+// Records the steady time from construction to destruction into a histogram.
+template <typename Histogram>
+class scoped_timer final {
+public:
+    using clock_t = std::chrono::steady_clock;
+
+    explicit scoped_timer(Histogram& histogram) noexcept : histogram_(histogram), started_(clock_t::now()) {}
+
+    ~scoped_timer() {
+        histogram_.record(clock_t::now() - started_);
+    }
+
+    scoped_timer(const scoped_timer&) = delete;
+    auto operator=(const scoped_timer&) -> auto& = delete;
+
+    auto elapsed() const noexcept {
+        return clock_t::now() - started_;
+    }
+
+private:
+    Histogram& histogram_;
+    const clock_t::time_point started_;
+};
+} // namespace hitycho::metrics
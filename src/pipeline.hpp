@@ -4,20 +4,105 @@
 #pragma once
 
 #include "system.hpp"
+#include "atomic.hpp"
 
+#include <hpx/future.hpp>
 #include <hpx/modules/threading.hpp>
 #include <hpx/synchronization/condition_variable.hpp>
 #include <hpx/synchronization/mutex.hpp>
 
+#include <array>
 #include <atomic>
+#include <chrono>
+#include <exception>
+#include <functional>
+#include <iterator>
+#include <mutex>
+#include <type_traits>
+#include <vector>
 
 namespace hitycho::system {
+// pipeline size for a capacity chosen when it is constructed
+constexpr std::size_t runtime_size = 0;
+
+struct pipeline_options final {
+    bool huge_pages{false};
+    int numa_node{-1}; // preferred node for the ring, such as a consumer's
+};
+
+namespace detail {
+template <typename T, std::size_t S>
+class ring_storage final {
+public:
+    constexpr auto size() const noexcept { return unsigned(S); }
+    constexpr auto huge_pages() const noexcept { return false; }
+    constexpr auto next(unsigned pos) const noexcept { return util::next_index<S>(pos); }
+    auto operator[](unsigned pos) noexcept -> T& { return data_[pos]; }
+    auto operator[](unsigned pos) const noexcept -> const T& { return data_[pos]; }
+
+private:
+    alignas(cache_line) T data_[S]{};
+};
+
+// ring allocated apart from its pipeline, and mapped when it is to be
+// placed on huge pages or a numa node. Rings smaller than a huge page
+// are not rounded up to one.
+template <typename T>
+class ring_storage<T, runtime_size> final {
+public:
+    ring_storage(std::size_t size, const pipeline_options& options) : size_(unsigned(size)), huge_(options.huge_pages && size * sizeof(T) >= atomic::detail::huge_size), node_(options.numa_node) {
+        if (!size || size > std::numeric_limits<unsigned>::max() / 2)
+            throw hitycho::range("Pipeline size invalid");
+        data_ = static_cast<T *>(atomic::detail::map_pages(bytes(), alignof(T), huge_, node_));
+        std::size_t made = 0;
+        try {
+            for (; made < size_; ++made)
+                ::new (static_cast<void *>(data_ + made)) T{};
+        } catch (...) {
+            destroy(made);
+            throw;
+        }
+    }
+
+    ring_storage(const ring_storage&) = delete;
+    auto operator=(const ring_storage&) -> auto& = delete;
+    ~ring_storage() { destroy(size_); }
+
+    auto size() const noexcept { return size_; }
+    auto huge_pages() const noexcept { return huge_; }
+    auto next(unsigned pos) const noexcept { return ++pos == size_ ? 0U : pos; }
+    auto operator[](unsigned pos) noexcept -> T& { return data_[pos]; }
+    auto operator[](unsigned pos) const noexcept -> const T& { return data_[pos]; }
+
+private:
+    const unsigned size_;
+    const bool huge_;
+    const int node_;
+    T *data_{nullptr};
+
+    auto bytes() const noexcept { return std::size_t(size_) * sizeof(T); }
+
+    void destroy(std::size_t made) noexcept {
+        while (made)
+            data_[--made].~T();
+        atomic::detail::unmap_pages(data_, bytes(), alignof(T), huge_, node_);
+    }
+};
+} // namespace detail
+
+// A pipeline of runtime_size has its capacity passed to the constructor,
+// and its ring may be backed by huge pages or placed on a numa node.
 template <typename T, std::size_t S>
 class pipeline {
 public:
+    using deadline_t = std::chrono::steady_clock::time_point;
+
+    pipeline() = default;
+    explicit pipeline(std::size_t size, const pipeline_options& options = {}) : data_(size, options) {}
     explicit operator bool() const noexcept { return !closed_; }
     auto operator!() const noexcept { return closed_; }
-    auto capacity() const noexcept { return S; }
+    auto capacity() const noexcept { return std::size_t(data_.size()); }
+    auto huge_pages() const noexcept { return data_.huge_pages(); }
     virtual ~pipeline() { close(); }
 
     auto is_open() const noexcept {
@@ -35,12 +120,14 @@ public:
     }
 
     void clear() {
-        const guard_t lock(lock_);
+        lock_t lock(lock_);
         auto prior = count_;
         while (count_ && drop_head(false))
             ;
-        if (prior > count_ && !closed_)
+        if (prior > count_ && !closed_) {
             input_.notify_one();
+            settle(lock);
+        }
     }
 
     void close() {
@@ -49,70 +136,162 @@ public:
             input_.notify_all();
             hpx::this_thread::yield();
             clear();
+            abandon();
         }
     }
 
     auto drop() {
-        const guard_t lock(lock_);
-        return drop_head(count_ == S);
+        lock_t lock(lock_);
+        if (!drop_head(count_ == data_.size())) return false;
+        settle(lock);
+        return true;
     }
 
     auto drop_if() { // drop if full
-        const guard_t lock(lock_);
-        if (count_ == S) return drop_head(true);
-        return false;
+        lock_t lock(lock_);
+        if (count_ < data_.size() || !drop_head(true)) return false;
+        settle(lock);
+        return true;
     }
 
     auto push(T&& data) {
         lock_t lock(lock_);
-        while (!closed_) {
-            if (count_ < S) {
-                data_[tail_] = std::move(data);
-                tail_ = (tail_ + 1) % S;
-                if (count_++ == 0) { // notify no longer empty
-                    output_.notify_one();
-                    this->notify(true);
-                }
-                return true;
-            }
-            full(lock);
-        }
-        return false;
+        return put(lock, std::move(data));
     }
 
     auto push(const T& data) {
         lock_t lock(lock_);
-        while (!closed_) {
-            if (count_ < S) {
-                data_[tail_] = data;
-                tail_ = (tail_ + 1) % S;
-                if (count_++ == 0) { // notify no longer empty
-                    output_.notify_one();
-                    this->notify(true);
-                }
-                return true;
-            }
-            full(lock);
-        }
-        return false;
+        return put(lock, data);
+    }
+
+    // timed pushes and pulls return false if the deadline passes first
+    auto push_until(T&& data, const deadline_t& deadline) {
+        lock_t lock(lock_, &deadline);
+        return put(lock, std::move(data));
+    }
+
+    auto push_until(const T& data, const deadline_t& deadline) {
+        lock_t lock(lock_, &deadline);
+        return put(lock, data);
+    }
+
+    template <typename Rep, typename Period>
+    auto push_for(T&& data, const std::chrono::duration<Rep, Period>& timeout) {
+        return push_until(std::move(data), std::chrono::steady_clock::now() + timeout);
+    }
+
+    template <typename Rep, typename Period>
+    auto push_for(const T& data, const std::chrono::duration<Rep, Period>& timeout) {
+        return push_until(data, std::chrono::steady_clock::now() + timeout);
     }
 
     auto pull(T& out) {
         lock_t lock(lock_);
-        while (!closed_) {
-            if (count_ > 0) {
-                out = std::move(data_[head_]);
-                clear_item(data_[head_], false); // moved...
-                head_ = (head_ + 1) % S;
-                if (count_-- == S) // notify push when no longer full...
-                    input_.notify_one();
-                if (!count_) // notify clears when emptied
-                    this->notify(false);
-                return true;
+        return get(lock, out);
+    }
+
+    auto pull_until(T& out, const deadline_t& deadline) {
+        lock_t lock(lock_, &deadline);
+        return get(lock, out);
+    }
+
+    template <typename Rep, typename Period>
+    auto pull_for(T& out, const std::chrono::duration<Rep, Period>& timeout) {
+        return pull_until(out, std::chrono::steady_clock::now() + timeout);
+    }
+
+    // Futures that complete from the other side of the pipeline rather than
+    // parking a thread, so they may be combined with hpx::when_any. A pull
+    // fails with invalid when the pipeline is closed, and a push is false if
+    // it closes before the item is queued.
+    auto async_pull() -> hpx::future<T> {
+        lock_t lock(lock_);
+        if (closed_) return hpx::make_exceptional_future<T>(std::make_exception_ptr(hitycho::invalid("Pipeline closed")));
+        if (!count_) {
+            pullers_.emplace_back();
+            return pullers_.back().get_future();
+        }
+        T out{};
+        get(lock, out);
+        return hpx::make_ready_future(std::move(out));
+    }
+
+    auto async_push(T&& data) -> hpx::future<bool> {
+        lock_t lock(lock_);
+        if (closed_) return hpx::make_ready_future(false);
+        try {
+            if (count_ < data_.size() || overflow(lock)) {
+                store(std::move(data));
+                serve(lock);
+                return hpx::make_ready_future(true);
             }
+        } catch (...) {
+            return hpx::make_exceptional_future<bool>(std::current_exception());
+        }
+        pushers_.emplace_back(std::move(data), hpx::promise<bool>());
+        return pushers_.back().second.get_future();
+    }
+
+    auto async_push(const T& data) -> hpx::future<bool> {
+        T copy(data);
+        return async_push(std::move(copy));
+    }
+
+    // pushes the range with one lock and one wakeup, waiting while full;
+    // returns how many were pushed before the range ended or a close
+    template <typename Iter>
+    auto push_range(Iter first, Iter last) {
+        return put_items(first, [&first, &last] { return first != last; });
+    }
+
+    template <typename Iter>
+    auto push_n(Iter first, std::size_t count) {
+        return put_items(first, [&count] {
+            if (!count) return false;
+            --count;
+            return true;
+        });
+    }
+
+    // waits for at least one item, or for min items until linger expires,
+    // then moves up to max items to out
+    template <typename Out>
+    auto pull_n(Out out, std::size_t max, std::size_t min = 1, std::chrono::milliseconds linger = std::chrono::milliseconds(0)) -> std::size_t {
+        lock_t lock(lock_);
+        auto waited = false;
+        while (!closed_ && !count_) {
             wait(lock);
+            waited = true;
         }
-        return false;
+        if (closed_) return 0;
+        if (count_ < min && linger.count() > 0) {
+            ++lingering_;
+            output_.wait_until(lock, std::chrono::steady_clock::now() + linger, [&] { return closed_ || count_ >= min; });
+            --lingering_;
+            if (closed_) return 0;
+        }
+        const auto taken = take_items(out, max);
+        if (waited && count_) // pass the wakeup on
+            output_.notify_one();
+        settle(lock);
+        return taken;
+    }
+
+    // moves every queued item out with one lock, then calls func on each
+    // outside the lock; never waits
+    template <typename Func>
+    auto drain(Func func) -> std::size_t {
+        std::vector<T> items;
+        {
+            lock_t lock(lock_);
+            if (closed_ || !count_) return 0;
+            items.reserve(count_);
+            take_items(std::back_inserter(items), count_);
+            settle(lock);
+        }
+        for (auto& item : items)
+            func(std::move(item));
+        return items.size();
     }
 
     template <typename Func>
@@ -144,27 +323,51 @@ public:
 protected:
     static_assert(std::is_pointer_v<T> || std::is_default_constructible_v<T>,
     "T must be a pointer or a non-deleted default constructor");
-    static_assert(S > 0, "pipeline size must be positive");
-    using lock_t = std::unique_lock<hpx::mutex>;
     using guard_t = std::lock_guard<hpx::mutex>;
 
+    // carries the deadline of a timed push or pull to the wait hooks
+    struct lock_t final : std::unique_lock<hpx::mutex> {
+        explicit lock_t(hpx::mutex& mutex, const deadline_t *deadline = nullptr) : std::unique_lock<hpx::mutex>(mutex), until(deadline) {}
+
+        const deadline_t *until{nullptr};
+        bool expired{false};
+    };
+
     mutable hpx::mutex lock_;
     hpx::condition_variable input_, output_;
-    T data_[S]{};
-    unsigned head_{0}, tail_{0}, count_{0};
+    unsigned head_{0}, tail_{0}, count_{0}, lingering_{0};
     std::atomic<bool> closed_{false};
+    std::vector<hpx::promise<T>> pullers_; // only allocated by async calls
+    std::vector<std::pair<T, hpx::promise<bool>>> pushers_;
+    detail::ring_storage<T, S> data_;
 
     virtual void wait(lock_t& lock) {
-        output_.wait(lock, [&] { return closed_ || count_ > 0; });
+        const auto ready = [&] { return closed_ || count_ > 0; };
+        if (!lock.until)
+            output_.wait(lock, ready);
+        else if (!output_.wait_until(lock, *lock.until, ready))
+            lock.expired = true;
     }
 
     virtual void full(lock_t& lock) {
-        input_.wait(lock, [&] { return closed_ || count_ < S; });
+        const auto ready = [&] { return closed_ || count_ < data_.size(); };
+        if (!lock.until)
+            input_.wait(lock, ready);
+        else if (!input_.wait_until(lock, *lock.until, ready))
+            lock.expired = true;
     }
 
+    // makes room for an async push that found the pipeline full, or
+    // returns false to leave it pending
+    virtual auto overflow([[maybe_unused]] lock_t& lock) -> bool { return false; }
     virtual void drop([[maybe_unused]] const T& obj) {}
     virtual void notify([[maybe_unused]] bool pending) {}
 
+    void drop_oldest() {
+        drop(data_[head_]); // optional drop fast proc
+        drop_head(false);   // silent drop...
+    }
+
     void clear_item(T& data, bool destroy = true) {
         if constexpr (std::is_pointer_v<T>) {
             if (destroy)
@@ -175,10 +378,174 @@ protected:
         }
     }
 
+    template <typename Item>
+    void store(Item&& data) {
+        data_[tail_] = std::forward<Item>(data);
+        tail_ = data_.next(tail_);
+        if (count_++ == 0) { // notify no longer empty
+            output_.notify_one();
+            this->notify(true);
+        } else if (lingering_)
+            output_.notify_all();
+    }
+
+    template <typename Item>
+    auto put(lock_t& lock, Item&& data) -> bool {
+        auto waited = false;
+        while (!closed_) {
+            if (count_ < data_.size()) {
+                store(std::forward<Item>(data));
+                if (waited && count_ < data_.size()) // pass the wakeup on
+                    input_.notify_one();
+                serve(lock);
+                return true;
+            }
+            full(lock);
+            if (lock.expired) return false;
+            waited = true;
+        }
+        return false;
+    }
+
+    auto get(lock_t& lock, T& out) -> bool {
+        auto waited = false;
+        while (!closed_) {
+            if (count_ > 0) {
+                out = std::move(data_[head_]);
+                clear_item(data_[head_], false); // moved...
+                head_ = data_.next(head_);
+                if (count_-- == data_.size()) // notify push when no longer full...
+                    input_.notify_one();
+                if (!count_) // notify clears when emptied
+                    this->notify(false);
+                else if (waited) // pass the wakeup on
+                    output_.notify_one();
+                settle(lock);
+                return true;
+            }
+            wait(lock);
+            if (lock.expired) return false;
+            waited = true;
+        }
+        return false;
+    }
+
+    // hands queued items to pending async pulls, which are completed once
+    // the lock is released
+    void serve(lock_t& lock) {
+        if (pullers_.empty() || !count_) return;
+        std::vector<std::pair<hpx::promise<T>, T>> done;
+        auto puller = pullers_.begin();
+        for (; puller != pullers_.end() && count_; ++puller) {
+            done.emplace_back(std::move(*puller), std::move(data_[head_]));
+            clear_item(data_[head_], false); // moved...
+            head_ = data_.next(head_);
+            --count_;
+        }
+        pullers_.erase(pullers_.begin(), puller);
+        if (!count_) // notify clears when emptied
+            this->notify(false);
+        lock.unlock();
+        for (auto& [promise, item] : done)
+            promise.set_value(std::move(item));
+    }
+
+    // moves pending async pushes into freed space, and completes them once
+    // the lock is released
+    void settle(lock_t& lock) {
+        if (pushers_.empty() || count_ == data_.size()) return;
+        std::vector<hpx::promise<bool>> done;
+        auto pusher = pushers_.begin();
+        for (; pusher != pushers_.end() && count_ < data_.size(); ++pusher) {
+            store(std::move(pusher->first));
+            done.push_back(std::move(pusher->second));
+        }
+        pushers_.erase(pushers_.begin(), pusher);
+        lock.unlock();
+        for (auto& promise : done)
+            promise.set_value(true);
+    }
+
+    // fails async pulls and pushes still pending at close
+    void abandon() {
+        lock_t lock(lock_);
+        auto pullers = std::move(pullers_);
+        auto pushers = std::move(pushers_);
+        lock.unlock();
+        for (auto& promise : pullers)
+            promise.set_exception(std::make_exception_ptr(hitycho::invalid("Pipeline closed")));
+        for (auto& [item, promise] : pushers) {
+            clear_item(item, true);
+            promise.set_value(false);
+        }
+    }
+
+    template <typename Iter, typename More>
+    auto put_items(Iter& first, More more) -> std::size_t {
+        lock_t lock(lock_);
+        std::size_t pushed = 0;
+        auto prior = count_;
+        auto waited = false;
+        while (!closed_ && more()) {
+            while (!closed_ && count_ == data_.size()) {
+                filled(prior);
+                full(lock);
+                prior = count_;
+                waited = true;
+            }
+            if (closed_) break;
+            data_[tail_] = *first;
+            ++first;
+            tail_ = data_.next(tail_);
+            ++count_;
+            ++pushed;
+        }
+        filled(prior);
+        if (waited && count_ < data_.size()) // pass the wakeup on
+            input_.notify_one();
+        serve(lock);
+        return pushed;
+    }
+
+    // one wakeup for everything added since count was prior
+    void filled(unsigned prior) {
+        if (count_ <= prior) return;
+        if (prior == 0) {
+            if (count_ - prior > 1)
+                output_.notify_all();
+            else
+                output_.notify_one();
+            this->notify(true);
+        } else if (lingering_)
+            output_.notify_all();
+    }
+
+    template <typename Out>
+    auto take_items(Out out, std::size_t max) -> std::size_t {
+        const auto prior = count_;
+        std::size_t taken = 0;
+        while (count_ && taken < max) {
+            *out++ = std::move(data_[head_]);
+            clear_item(data_[head_], false); // moved...
+            head_ = data_.next(head_);
+            --count_;
+            ++taken;
+        }
+        if (prior == data_.size() && taken) { // notify push when no longer full...
+            if (taken > 1)
+                input_.notify_all();
+            else
+                input_.notify_one();
+        }
+        if (taken && !count_) // notify clears when emptied
+            this->notify(false);
+        return taken;
+    }
+
     auto drop_head(bool notify = true) {
         if (!count_) return false;
         clear_item(data_[head_], true);
-        head_ = (head_ + 1) % S;
+        head_ = data_.next(head_);
         count_--;
         if (notify)
             input_.notify_one();
@@ -186,50 +553,926 @@ protected:
     }
 };
 
+// Lockfree pipeline core. Items move thru an MPMC ring, and producers and
+// consumers only park on an hpx wait queue when it is full or empty. The
+// drop, throw, and notify policies may be applied to it as to pipeline.
 template <typename T, std::size_t S>
-class drop_pipeline : public pipeline<T, S> {
+class lockfree_pipeline {
 public:
-    drop_pipeline() = default;
+    explicit operator bool() const noexcept { return !closed_; }
+    auto operator!() const noexcept { return closed_.load(); }
+    auto capacity() const noexcept { return S; }
+    virtual ~lockfree_pipeline() { close(); }
 
-private:
-    using lock_t = std::unique_lock<hpx::mutex>;
+    auto is_open() const noexcept {
+        return !closed_;
+    }
 
-    void full([[maybe_unused]] lock_t& lock) final {
-        this->drop(this->data_[this->head_]); // optional drop fast proc
-        this->drop_head(false);               // silent drop...
+    auto empty() const noexcept {
+        return count() == 0;
     }
-};
 
-template <typename T, std::size_t S>
-class throw_pipeline : public pipeline<T, S> {
-public:
-    throw_pipeline() = default;
+    auto count() const noexcept -> std::size_t {
+        const auto count = count_.load(std::memory_order_acquire);
+        return count > 0 ? std::size_t(count) : 0;
+    }
 
-private:
-    using lock_t = std::unique_lock<hpx::mutex>;
+    void clear() {
+        T item{};
+        while (take(item))
+            clear_item(item, true);
+    }
 
-    void full([[maybe_unused]] lock_t& lock) final {
-        throw hitycho::invalid("Pipeline ful");
+    void close() {
+        if (!closed_.exchange(true)) {
+            atomic::detail::unpark(&count_);
+            atomic::detail::unpark(&closed_);
+            hpx::this_thread::yield();
+            clear();
+        }
     }
-};
 
-template <typename T, std::size_t S>
-class notify_pipeline : public pipeline<T, S> {
-public:
-    notify_pipeline() = default;
+    auto drop() {
+        T item{};
+        if (!take(item)) return false;
+        clear_item(item, true);
+        return true;
+    }
 
-    operator int() const noexcept { return notify_.handle(); } // select / poll
-    auto handle() const noexcept { return notify_.handle(); }
-    auto wait(int timeout = 0) noexcept { return notify_.wait(timeout); }
+    auto drop_if() { // drop if full
+        if (count() < S) return false;
+        return drop();
+    }
 
-    void notify(bool pending) final {
-        if (pending)
-            notify_.signal();
-        else
-            notify_.clear();
+    auto try_push(T&& data) {
+        if (closed_ || !ring_.try_push(std::move(data))) return false;
+        placed();
+        return true;
     }
 
-private:
-    system::notify_t notify_;
+    auto try_pull(T& out) {
+        return !closed_ && take(out);
+    }
+
+    auto push(T&& data) {
+        lock_t lock;
+        while (!closed_) {
+            if (ring_.try_push(std::move(data))) {
+                placed();
+                return true;
+            }
+            full(lock);
+        }
+        return false;
+    }
+
+    auto push(const T& data) {
+        T copy(data);
+        return push(std::move(copy));
+    }
+
+    auto pull(T& out) {
+        lock_t lock;
+        while (!closed_) {
+            if (take(out)) return true;
+            wait(lock);
+        }
+        return false;
+    }
+
+    auto operator<<(T&& data) -> lockfree_pipeline& {
+        if (!push(std::move(data)))
+            throw hitycho::invalid("Pipeline closed");
+        return *this;
+    }
+
+    auto operator<<(const T& data) -> lockfree_pipeline& {
+        if (!push(data))
+            throw hitycho::invalid("Pipeline closed");
+        return *this;
+    }
+
+    auto operator>>(T& out) -> lockfree_pipeline& {
+        if (!pull(out))
+            throw hitycho::invalid("Pipeline closed");
+        return *this;
+    }
+
+protected:
+    static_assert(std::is_pointer_v<T> || std::is_default_constructible_v<T>,
+    "T must be a pointer or a non-deleted default constructor");
+
+    // policies share the pipeline hook signatures, but nothing is held
+    struct lock_t final {};
+
+    std::atomic<bool> closed_{false};
+    std::atomic_flag notifying_ = ATOMIC_FLAG_INIT;
+    bool pending_{false}; // last state passed to notify
+    alignas(cache_line) std::atomic<std::ptrdiff_t> count_{0};
+    atomic::ring_t<T, S> ring_;
+
+    virtual void wait([[maybe_unused]] lock_t& lock) {
+        atomic::detail::park(&count_, [this] { return closed_ || count_.load(std::memory_order_acquire) > 0; });
+    }
+
+    virtual void full([[maybe_unused]] lock_t& lock) {
+        atomic::detail::park(&closed_, [this] { return closed_ || count_.load(std::memory_order_acquire) < std::ptrdiff_t(S); });
+    }
+
+    // there are no async pushes here; kept so the policies apply
+    virtual auto overflow([[maybe_unused]] lock_t& lock) -> bool { return false; }
+
+    virtual void drop([[maybe_unused]] const T& obj) {}
+    virtual void notify([[maybe_unused]] bool pending) {}
+
+    void drop_oldest() {
+        T item{};
+        if (!take(item)) return;
+        drop(item);
+        clear_item(item, true);
+    }
+
+    static void clear_item(T& data, bool destroy = true) {
+        if constexpr (std::is_pointer_v<T>) {
+            if (destroy)
+                delete data;
+            data = nullptr;
+        } else {
+            data = std::move(T{});
+        }
+    }
+
+    // the count may briefly trail the ring; wakeups follow its transitions
+    void placed() {
+        if (count_.fetch_add(1, std::memory_order_acq_rel) <= 0) {
+            atomic::detail::unpark(&count_);
+            settle();
+        }
+    }
+
+    auto take(T& out) -> bool {
+        if (!ring_.try_pop(out)) return false;
+        const auto prior = count_.fetch_sub(1, std::memory_order_acq_rel);
+        if (prior >= std::ptrdiff_t(S))
+            atomic::detail::unpark(&closed_);
+        if (prior <= 1) // notify clears when emptied
+            settle();
+        return true;
+    }
+
+    // transitions race, so notify follows the count as it is now rather
+    // than the transition, and only when that state changes
+    void settle() noexcept {
+        while (notifying_.test_and_set(std::memory_order_acquire))
+            atomic::detail::spin_pause();
+        const auto pending = count_.load(std::memory_order_acquire) > 0;
+        if (pending != pending_) {
+            pending_ = pending;
+            this->notify(pending);
+        }
+        notifying_.clear(std::memory_order_release);
+    }
+};
+
+template <typename T, std::size_t S, template <typename, std::size_t> class Core = pipeline>
+class drop_pipeline : public Core<T, S> {
+public:
+    drop_pipeline() = default;
+    using Core<T, S>::Core;
+
+private:
+    using lock_t = typename Core<T, S>::lock_t;
+
+    void full([[maybe_unused]] lock_t& lock) final {
+        this->drop_oldest();
+    }
+
+    auto overflow([[maybe_unused]] lock_t& lock) -> bool final {
+        this->drop_oldest();
+        return true;
+    }
+};
+
+template <typename T, std::size_t S, template <typename, std::size_t> class Core = pipeline>
+class throw_pipeline : public Core<T, S> {
+public:
+    throw_pipeline() = default;
+    using Core<T, S>::Core;
+
+private:
+    using lock_t = typename Core<T, S>::lock_t;
+
+    void full([[maybe_unused]] lock_t& lock) final {
+        throw hitycho::invalid("Pipeline ful");
+    }
+
+    auto overflow([[maybe_unused]] lock_t& lock) -> bool final {
+        throw hitycho::invalid("Pipeline ful");
+    }
+};
+
+template <typename T, std::size_t S, template <typename, std::size_t> class Core = pipeline>
+class notify_pipeline : public Core<T, S> {
+public:
+    notify_pipeline() = default;
+    using Core<T, S>::Core;
+
+    operator int() const noexcept { return notify_.handle(); } // select / poll
+    auto handle() const noexcept { return notify_.handle(); }
+    auto wait(int timeout = 0) noexcept { return notify_.wait(timeout); }
+
+    void notify(bool pending) final {
+        if (pending)
+            notify_.signal();
+        else
+            notify_.clear();
+    }
+
+private:
+    system::notify_t notify_;
+};
+
+// Pipeline with lanes by priority, lane 0 being the most urgent, so control
+// messages may overtake bulk data. The lanes share one capacity and one
+// wakeup path. Pulls take from the most urgent lane with items, or when
+// lanes are given weights, serve each lane up to its weight in turn so bulk
+// lanes are not starved. Push and operator<< use the last lane by default.
+template <typename T, std::size_t S, std::size_t Lanes = 2>
+class priority_pipeline {
+public:
+    priority_pipeline() = default;
+
+    explicit priority_pipeline(const std::array<unsigned, Lanes>& weights) : weighted_(true) {
+        for (std::size_t lane = 0; lane < Lanes; ++lane)
+            lanes_[lane].weight = weights[lane] ? weights[lane] : 1;
+    }
+
+    explicit operator bool() const noexcept { return !closed_; }
+    auto operator!() const noexcept { return closed_.load(); }
+    auto capacity() const noexcept { return S; }
+    auto lanes() const noexcept { return Lanes; }
+    virtual ~priority_pipeline() { close(); }
+
+    auto is_open() const noexcept {
+        return !closed_;
+    }
+
+    auto empty() const noexcept {
+        const guard_t lock(lock_);
+        return count_ == 0;
+    }
+
+    auto count() const noexcept {
+        const guard_t lock(lock_);
+        return count_;
+    }
+
+    auto count(std::size_t lane) const {
+        const guard_t lock(lock_);
+        return at(lane).count;
+    }
+
+    void clear() {
+        const guard_t lock(lock_);
+        auto prior = count_;
+        for (auto& from : lanes_) {
+            while (from.count)
+                drop_head(from);
+        }
+        if (prior && !closed_)
+            input_.notify_all();
+    }
+
+    void close() {
+        if (!closed_.exchange(true)) {
+            output_.notify_all();
+            input_.notify_all();
+            hpx::this_thread::yield();
+            clear();
+        }
+    }
+
+    auto drop() { // drops oldest of the least urgent lane
+        const guard_t lock(lock_);
+        return drop_below(0, count_ == S);
+    }
+
+    auto drop_if() { // drop if full
+        const guard_t lock(lock_);
+        if (count_ == S) return drop_below(0, true);
+        return false;
+    }
+
+    auto push(T&& data, std::size_t lane = Lanes - 1) {
+        lock_t lock(lock_);
+        auto& to = at(lane);
+        auto waited = false;
+        while (!closed_) {
+            if (count_ < S) {
+                to.data[to.tail] = std::move(data);
+                to.tail = to.data.next(to.tail);
+                ++to.count;
+                if (count_++ == 0) // notify no longer empty
+                    output_.notify_one();
+                if (waited && count_ < S) // pass the wakeup on
+                    input_.notify_one();
+                return true;
+            }
+            if (!full(lock, lane)) { // nothing less urgent to displace
+                drop(data);
+                clear_item(data, true);
+                return true;
+            }
+            waited = true;
+        }
+        return false;
+    }
+
+    auto push(const T& data, std::size_t lane = Lanes - 1) {
+        T copy(data);
+        return push(std::move(copy), lane);
+    }
+
+    auto pull(T& out) {
+        std::size_t lane{0};
+        return pull(out, lane);
+    }
+
+    auto pull(T& out, std::size_t& lane) {
+        lock_t lock(lock_);
+        auto waited = false;
+        while (!closed_) {
+            if (count_ > 0) {
+                lane = select();
+                auto& from = lanes_[lane];
+                out = std::move(from.data[from.head]);
+                clear_item(from.data[from.head], false); // moved...
+                from.head = from.data.next(from.head);
+                --from.count;
+                if (count_-- == S) // notify push when no longer full...
+                    input_.notify_one();
+                if (waited && count_) // pass the wakeup on
+                    output_.notify_one();
+                return true;
+            }
+            output_.wait(lock, [&] { return closed_ || count_ > 0; });
+            waited = true;
+        }
+        return false;
+    }
+
+    auto operator<<(T&& data) -> priority_pipeline& {
+        if (!push(std::move(data)))
+            throw hitycho::invalid("Pipeline closed");
+        return *this;
+    }
+
+    auto operator<<(const T& data) -> priority_pipeline& {
+        if (!push(data))
+            throw hitycho::invalid("Pipeline closed");
+        return *this;
+    }
+
+    auto operator>>(T& out) -> priority_pipeline& {
+        if (!pull(out))
+            throw hitycho::invalid("Pipeline closed");
+        return *this;
+    }
+
+protected:
+    static_assert(std::is_pointer_v<T> || std::is_default_constructible_v<T>,
+    "T must be a pointer or a non-deleted default constructor");
+    static_assert(S > 0 && Lanes > 0, "pipeline size and lanes must be positive");
+    using lock_t = std::unique_lock<hpx::mutex>;
+    using guard_t = std::lock_guard<hpx::mutex>;
+
+    struct lane_t final {
+        detail::ring_storage<T, S> data;
+        unsigned head{0}, tail{0}, count{0}, weight{1}, credit{0};
+    };
+
+    mutable hpx::mutex lock_;
+    hpx::condition_variable input_, output_;
+    unsigned count_{0};
+    const bool weighted_{false};
+    std::atomic<bool> closed_{false};
+    lane_t lanes_[Lanes];
+
+    // waits for room by default; false has the pushed item dropped instead
+    virtual auto full(lock_t& lock, [[maybe_unused]] std::size_t lane) -> bool {
+        input_.wait(lock, [&] { return closed_ || count_ < S; });
+        return true;
+    }
+
+    virtual void drop([[maybe_unused]] const T& obj) {}
+
+    auto at(std::size_t lane) const -> const lane_t& {
+        if (lane >= Lanes) throw hitycho::range("Pipeline lane invalid");
+        return lanes_[lane];
+    }
+
+    auto at(std::size_t lane) -> lane_t& {
+        if (lane >= Lanes) throw hitycho::range("Pipeline lane invalid");
+        return lanes_[lane];
+    }
+
+    // most urgent lane with items, or the most urgent with credit left in
+    // the current weighted round
+    auto select() noexcept -> std::size_t {
+        if (weighted_) {
+            for (auto round = 0; round < 2; ++round) {
+                for (std::size_t lane = 0; lane < Lanes; ++lane) {
+                    auto& from = lanes_[lane];
+                    if (from.count && from.credit) {
+                        --from.credit;
+                        return lane;
+                    }
+                }
+                for (auto& from : lanes_)
+                    from.credit = from.weight;
+            }
+        }
+        std::size_t lane = 0;
+        while (lane < Lanes - 1 && !lanes_[lane].count)
+            ++lane;
+        return lane;
+    }
+
+    static void clear_item(T& data, bool destroy = true) {
+        if constexpr (std::is_pointer_v<T>) {
+            if (destroy)
+                delete data;
+            data = nullptr;
+        } else {
+            data = std::move(T{});
+        }
+    }
+
+    void drop_head(lane_t& from) {
+        clear_item(from.data[from.head], true);
+        from.head = from.data.next(from.head);
+        --from.count;
+        --count_;
+    }
+
+    // drops the oldest item of the least urgent lane at or after lane
+    auto drop_below(std::size_t lane, bool notify) -> bool {
+        for (auto pos = Lanes; pos-- > lane;) {
+            auto& from = lanes_[pos];
+            if (!from.count) continue;
+            drop(from.data[from.head]); // optional drop fast proc
+            drop_head(from);
+            if (notify)
+                input_.notify_one();
+            return true;
+        }
+        return false;
+    }
+};
+
+// When full, a push displaces the oldest item of the least urgent lane that
+// is no more urgent than its own, so bulk data is dropped before control.
+template <typename T, std::size_t S, std::size_t Lanes = 2>
+class drop_priority_pipeline : public priority_pipeline<T, S, Lanes> {
+public:
+    drop_priority_pipeline() = default;
+    using priority_pipeline<T, S, Lanes>::priority_pipeline;
+
+private:
+    using lock_t = typename priority_pipeline<T, S, Lanes>::lock_t;
+
+    auto full([[maybe_unused]] lock_t& lock, std::size_t lane) -> bool final {
+        return this->drop_below(lane, false);
+    }
+};
+
+// Pipeline partitioned by key over N shards with one consumer each, so keys
+// such as sessions are consumed in order while shards run in parallel. Keys
+// hash to buckets that are owned by a shard. An item stays in flight until
+// its consumer pulls again or calls done, and with stealing an idle consumer
+// may take over a whole waiting bucket from a busy shard. A bucket may hold
+// several keys, which all move with it. Each shard holds up to S queued
+// items, kept in a fixed node pool so puts do not allocate.
+template <typename T, std::size_t S, std::size_t N, typename KeyOf, typename Hash = std::hash<std::decay_t<std::invoke_result_t<KeyOf, const T&>>>>
+class sharded_pipeline {
+public:
+    explicit sharded_pipeline(KeyOf key = KeyOf{}, Hash hash = Hash{}, bool stealing = false) : key_(std::move(key)), hash_(std::move(hash)), stealing_(stealing) {
+        for (std::size_t bucket = 0; bucket < buckets; ++bucket)
+            owners_[bucket].store(unsigned(bucket % N), std::memory_order_relaxed);
+        for (std::size_t node = 0; node < S * N; ++node)
+            nodes_[node].next.store(node + 1 < S * N ? std::uint32_t(node + 1) : no_node, std::memory_order_relaxed);
+    }
+
+    sharded_pipeline(const sharded_pipeline&) = delete;
+    auto operator=(const sharded_pipeline&) -> auto& = delete;
+    virtual ~sharded_pipeline() { close(); }
+
+    explicit operator bool() const noexcept { return !closed_; }
+    auto operator!() const noexcept { return closed_.load(); }
+    auto capacity() const noexcept { return S * N; }
+    auto shards() const noexcept { return N; }
+
+    auto is_open() const noexcept {
+        return !closed_;
+    }
+
+    auto empty() const noexcept {
+        return count() == 0;
+    }
+
+    auto count() const noexcept {
+        std::size_t total = 0;
+        for (const auto& shard : shards_) {
+            const guard_t lock(shard.lock);
+            total += shard.count;
+        }
+        return total;
+    }
+
+    auto count(std::size_t shard) const {
+        const guard_t lock(at(shard).lock);
+        return shards_[shard].count;
+    }
+
+    // shard currently consuming the key of item
+    auto shard_of(const T& item) const noexcept -> std::size_t {
+        return owners_[bucket_of(item)].load(std::memory_order_acquire);
+    }
+
+    void close() {
+        if (closed_.exchange(true)) return;
+        for (auto& shard : shards_) {
+            const guard_t lock(shard.lock);
+            shard.output.notify_all();
+            shard.input.notify_all();
+        }
+        hpx::this_thread::yield();
+        for (auto& shard : shards_) {
+            const guard_t lock(shard.lock);
+            take_all(shard, [](T& item) { clear_item(item, true); });
+        }
+    }
+
+    // moves every queued item out of every shard, keeping key order, then
+    // calls func on each outside the locks; never waits
+    template <typename Func>
+    auto drain(Func func) -> std::size_t {
+        std::vector<T> items;
+        if (closed_) return 0;
+        for (auto& shard : shards_) {
+            const guard_t lock(shard.lock);
+            items.reserve(items.size() + shard.count);
+            take_all(shard, [&items](T& item) { items.push_back(std::move(item)); });
+        }
+        for (auto& item : items)
+            func(std::move(item));
+        return items.size();
+    }
+
+    auto push(T&& data) {
+        return put(std::move(data));
+    }
+
+    auto push(const T& data) {
+        return put(data);
+    }
+
+    // pulls the next item for the consumer of shard, first completing the
+    // item it pulled before
+    // an idle consumer is marked before it looks for a bucket to steal, so
+    // a shard that gains one after it looked will wake it
+    auto pull(std::size_t shard, T& out) {
+        auto& self = at(shard);
+        lock_t lock(self.lock);
+        auto grew = finish(self);
+        while (!closed_) {
+            if (take(self, out)) {
+                idle(self, false);
+                const auto wake = grew && offers(self);
+                lock.unlock();
+                if (wake) wake_idle(shard);
+                return true;
+            }
+            if (!stealing_) {
+                self.output.wait(lock);
+                continue;
+            }
+            idle(self, true);
+            const auto wakeups = self.wakeups;
+            lock.unlock();
+            const auto stolen = steal(shard);
+            lock.lock();
+            grew = false;
+            if (!stolen)
+                self.output.wait(lock, [&] { return closed_ || self.waiting || self.wakeups != wakeups; });
+        }
+        idle(self, false);
+        return false;
+    }
+
+    auto try_pull(std::size_t shard, T& out) {
+        auto& self = at(shard);
+        lock_t lock(self.lock);
+        const auto grew = finish(self);
+        if (closed_) return false;
+        if (take(self, out)) {
+            const auto wake = grew && offers(self);
+            lock.unlock();
+            if (wake) wake_idle(shard);
+            return true;
+        }
+        if (!stealing_) return false;
+        lock.unlock();
+        if (!steal(shard)) return false;
+        lock.lock();
+        return !closed_ && take(self, out);
+    }
+
+    // completes the item in flight so its key may move to another shard
+    void done(std::size_t shard) {
+        auto& self = at(shard);
+        lock_t lock(self.lock);
+        const auto wake = finish(self) && offers(self);
+        lock.unlock();
+        if (wake) wake_idle(shard);
+    }
+
+    auto operator<<(T&& data) -> sharded_pipeline& {
+        if (!push(std::move(data)))
+            throw hitycho::invalid("Pipeline closed");
+        return *this;
+    }
+
+    auto operator<<(const T& data) -> sharded_pipeline& {
+        if (!push(data))
+            throw hitycho::invalid("Pipeline closed");
+        return *this;
+    }
+
+protected:
+    static_assert(std::is_pointer_v<T> || std::is_default_constructible_v<T>,
+    "T must be a pointer or a non-deleted default constructor");
+    static_assert(S > 0 && N > 0, "pipeline size and shards must be positive");
+    static_assert(S * N < std::numeric_limits<std::uint32_t>::max(), "pipeline too large");
+    using lock_t = std::unique_lock<hpx::mutex>;
+    using guard_t = std::lock_guard<hpx::mutex>;
+
+    static constexpr std::size_t buckets = N * 16;
+    static constexpr std::size_t none = buckets;
+    static constexpr auto no_node = ~std::uint32_t(0);
+
+    // items are kept in a fixed pool of S * N nodes, enough for every shard
+    // to be full, and queued thru intrusive links so nothing is allocated
+    struct node_t final {
+        T item{};
+        std::atomic<std::uint32_t> next{no_node};
+    };
+
+    struct bucket_t final {
+        std::uint32_t head{no_node}, tail{no_node};
+        std::size_t size{0}, prev{none}, next{none}; // links while ready
+        bool busy{false};
+    };
+
+    struct alignas(cache_line) shard_t final {
+        mutable hpx::mutex lock;
+        hpx::condition_variable input, output;
+        std::size_t first{none}, last{none}, waiting{0}; // ready buckets
+        std::size_t count{0}, current{none}, wakeups{0};
+        std::atomic<bool> idle{false}; // consumer is looking to steal
+    };
+
+    KeyOf key_;
+    Hash hash_;
+    const bool stealing_{false};
+    std::atomic<bool> closed_{false};
+    std::atomic<std::size_t> idlers_{0};
+    shard_t shards_[N];
+    std::atomic<unsigned> owners_[buckets]{};
+    bucket_t buckets_[buckets]; // guarded by the owning shard
+    node_t nodes_[S * N];
+    alignas(cache_line) std::atomic<std::uint64_t> free_{0}; // tag and index
+
+    auto at(std::size_t shard) const -> const shard_t& {
+        if (shard >= N) throw hitycho::range("Pipeline shard invalid");
+        return shards_[shard];
+    }
+
+    auto at(std::size_t shard) -> shard_t& {
+        if (shard >= N) throw hitycho::range("Pipeline shard invalid");
+        return shards_[shard];
+    }
+
+    auto bucket_of(const T& item) const noexcept -> std::size_t {
+        return atomic::detail::mix_hash(std::uint64_t(hash_(std::invoke(key_, item)))) % buckets;
+    }
+
+    static void clear_item(T& data, bool destroy = true) {
+        if constexpr (std::is_pointer_v<T>) {
+            if (destroy)
+                delete data;
+            data = nullptr;
+        } else {
+            data = std::move(T{});
+        }
+    }
+
+    // the owner of a bucket only changes while it is waiting in a shard,
+    // so it is checked again once the shard is locked
+    template <typename Item>
+    auto put(Item&& data) -> bool {
+        const auto id = bucket_of(data);
+        auto& bucket = buckets_[id];
+        for (;;) {
+            const auto owner = owners_[id].load(std::memory_order_acquire);
+            auto& shard = shards_[owner];
+            lock_t lock(shard.lock);
+            if (closed_) return false;
+            if (owners_[id].load(std::memory_order_relaxed) != owner) continue;
+            if (shard.count >= S) {
+                shard.input.wait(lock);
+                continue;
+            }
+            const auto grew = !bucket.size && !bucket.busy;
+            if (grew)
+                ready(shard, id);
+            const auto node = acquire();
+            nodes_[node].item = std::forward<Item>(data);
+            append(bucket, node);
+            if (shard.count++ == 0) // notify no longer empty
+                shard.output.notify_one();
+            const auto wake = grew && offers(shard);
+            lock.unlock();
+            if (wake) wake_idle(owner);
+            return true;
+        }
+    }
+
+    auto take(shard_t& shard, T& out) -> bool {
+        if (!shard.waiting) return false;
+        const auto id = shard.first;
+        auto& bucket = buckets_[id];
+        unready(shard, id);
+        const auto node = bucket.head;
+        out = std::move(nodes_[node].item);
+        clear_item(nodes_[node].item, false); // moved...
+        bucket.head = nodes_[node].next.load(std::memory_order_relaxed);
+        if (--bucket.size == 0)
+            bucket.tail = no_node;
+        release(node);
+        bucket.busy = true;
+        shard.current = id;
+        if (shard.count-- == S) // notify push when no longer full...
+            shard.input.notify_all();
+        return true;
+    }
+
+    // true if a waiting bucket was returned to the shard
+    auto finish(shard_t& shard) -> bool {
+        if (shard.current == none) return false;
+        auto& bucket = buckets_[shard.current];
+        const auto grew = bucket.size > 0;
+        bucket.busy = false;
+        if (grew)
+            ready(shard, shard.current);
+        shard.current = none;
+        return grew;
+    }
+
+    // a shard has a bucket to steal beyond the one its consumer takes next,
+    // and some consumer is idle to take it
+    auto offers(const shard_t& shard) const noexcept {
+        if (!stealing_ || !idlers_.load(std::memory_order_acquire)) return false;
+        return shard.waiting > 1 || (shard.waiting && shard.current != none);
+    }
+
+    void idle(shard_t& shard, bool idle) noexcept {
+        if (shard.idle.exchange(idle, std::memory_order_acq_rel) == idle) return;
+        if (idle)
+            idlers_.fetch_add(1, std::memory_order_acq_rel);
+        else
+            idlers_.fetch_sub(1, std::memory_order_acq_rel);
+    }
+
+    // wakes the next idle consumer after the offering shard
+    void wake_idle(std::size_t from) {
+        for (std::size_t offset = 1; offset < N; ++offset) {
+            auto& shard = shards_[(from + offset) % N];
+            if (!shard.idle.load(std::memory_order_acquire)) continue;
+            const guard_t lock(shard.lock);
+            if (!shard.idle.load(std::memory_order_relaxed)) continue;
+            ++shard.wakeups;
+            shard.output.notify_one();
+            return;
+        }
+    }
+
+    void ready(shard_t& shard, std::size_t id) noexcept {
+        auto& bucket = buckets_[id];
+        bucket.prev = shard.last;
+        bucket.next = none;
+        if (shard.last != none)
+            buckets_[shard.last].next = id;
+        else
+            shard.first = id;
+        shard.last = id;
+        ++shard.waiting;
+    }
+
+    void unready(shard_t& shard, std::size_t id) noexcept {
+        auto& bucket = buckets_[id];
+        if (bucket.prev != none)
+            buckets_[bucket.prev].next = bucket.next;
+        else
+            shard.first = bucket.next;
+        if (bucket.next != none)
+            buckets_[bucket.next].prev = bucket.prev;
+        else
+            shard.last = bucket.prev;
+        bucket.prev = bucket.next = none;
+        --shard.waiting;
+    }
+
+    void append(bucket_t& bucket, std::uint32_t node) noexcept {
+        nodes_[node].next.store(no_node, std::memory_order_relaxed);
+        if (bucket.tail != no_node)
+            nodes_[bucket.tail].next.store(node, std::memory_order_relaxed);
+        else
+            bucket.head = node;
+        bucket.tail = node;
+        ++bucket.size;
+    }
+
+    // the free list is shared by every shard, so it is a tagged lockfree
+    // stack; a shard under S items always finds a free node
+    auto acquire() noexcept -> std::uint32_t {
+        auto head = free_.load(std::memory_order_acquire);
+        for (;;) {
+            const auto node = std::uint32_t(head);
+            const auto next = nodes_[node].next.load(std::memory_order_relaxed);
+            const auto changed = (((head >> 32) + 1) << 32) | next;
+            if (free_.compare_exchange_weak(head, changed, std::memory_order_acquire, std::memory_order_acquire)) return node;
+        }
+    }
+
+    void release(std::uint32_t node) noexcept {
+        auto head = free_.load(std::memory_order_relaxed);
+        for (;;) {
+            nodes_[node].next.store(std::uint32_t(head), std::memory_order_relaxed);
+            const auto changed = (((head >> 32) + 1) << 32) | node;
+            if (free_.compare_exchange_weak(head, changed, std::memory_order_release, std::memory_order_relaxed)) return;
+        }
+    }
+
+    // moves a waiting bucket, with its items and so every key hashed to it,
+    // from a shard that still has other work to the idle shard
+    auto steal(std::size_t thief) -> bool {
+        for (std::size_t offset = 1; offset < N; ++offset) {
+            const auto victim = (thief + offset) % N;
+            auto& from = shards_[victim];
+            auto& to = shards_[thief];
+            const std::scoped_lock lock(to.lock, from.lock);
+            if (closed_) return false;
+            if (to.waiting) return true; // work arrived meanwhile
+            if (!from.waiting || (from.waiting < 2 && from.current == none)) continue;
+            const auto id = from.last;
+            const auto moved = buckets_[id].size;
+            unready(from, id);
+            owners_[id].store(unsigned(thief), std::memory_order_release);
+            ready(to, id);
+            to.count += moved;
+            if (from.count == S)
+                from.input.notify_all();
+            from.count -= moved;
+            return true;
+        }
+        return false;
+    }
+
+    template <typename Func>
+    void take_all(shard_t& shard, Func func) {
+        const auto emptied = [&](std::size_t id) {
+            auto& bucket = buckets_[id];
+            while (bucket.head != no_node) {
+                const auto node = bucket.head;
+                bucket.head = nodes_[node].next.load(std::memory_order_relaxed);
+                func(nodes_[node].item);
+                clear_item(nodes_[node].item, false);
+                release(node);
+            }
+            bucket.tail = no_node;
+            bucket.size = 0;
+        };
+        while (shard.waiting) {
+            const auto id = shard.first;
+            unready(shard, id);
+            emptied(id);
+        }
+        if (shard.current != none)
+            emptied(shard.current);
+        if (shard.count == S)
+            shard.input.notify_all();
+        shard.count = 0;
+    }
 };
 } // namespace hitycho::system
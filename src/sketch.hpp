@@ -0,0 +1,291 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright (C) 2025 David Sugar <tychosoft@gmail.com>
+
+#pragma once
+
+#include "atomic.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace hitycho::sketch {
+// Blocked Bloom filter. All bits for a key fall in one cache line sized
+// block, so a lookup costs one cache miss. Inserts are lockfree thru
+// fetch_or, and filters of the same geometry may be merged.
+template <typename K, typename Hash = std::hash<K>>
+class bloom_t final {
+public:
+    explicit bloom_t(std::size_t expected, double rate = 0.01) : count_(block_count(bits_for(expected, rate))), hashes_(hashes_for(expected, count_ * block_bits)), blocks_(new block_t[count_]) {}
+
+    bloom_t(const bloom_t&) = delete;
+    auto operator=(const bloom_t&) -> auto& = delete;
+
+    auto operator|=(const bloom_t& other) -> auto& {
+        merge(other);
+        return *this;
+    }
+
+    static auto bits_for(std::size_t expected, double rate) -> std::size_t {
+        if (!expected || rate <= 0.0 || rate >= 1.0) throw invalid("Invalid bloom filter sizing");
+        const auto ln2 = std::log(2.0);
+        return std::size_t(std::ceil(-double(expected) * std::log(rate) / (ln2 * ln2)));
+    }
+
+    static auto hashes_for(std::size_t expected, std::size_t bits) noexcept -> unsigned {
+        const auto best = std::lround(double(bits) / double(expected ? expected : 1) * std::log(2.0));
+        return unsigned(std::clamp(best, 1L, long(max_hashes)));
+    }
+
+    auto bits() const noexcept {
+        return count_ * block_bits;
+    }
+
+    auto hashes() const noexcept {
+        return hashes_;
+    }
+
+    // true if any bit was newly set, so the key was certainly not present
+    auto insert(const K& key) noexcept {
+        std::uint64_t mask[block_words]{};
+        auto& block = locate(key, mask);
+        auto changed = false;
+        for (std::size_t word = 0; word < block_words; ++word) {
+            if (!mask[word]) continue;
+            if ((block.words[word].fetch_or(mask[word], std::memory_order_relaxed) & mask[word]) != mask[word])
+                changed = true;
+        }
+        return changed;
+    }
+
+    auto contains(const K& key) const noexcept {
+        std::uint64_t mask[block_words]{};
+        const auto& block = locate(key, mask);
+        for (std::size_t word = 0; word < block_words; ++word) {
+            if ((block.words[word].load(std::memory_order_relaxed) & mask[word]) != mask[word]) return false;
+        }
+        return true;
+    }
+
+    void merge(const bloom_t& other) {
+        if (other.count_ != count_ || other.hashes_ != hashes_) throw invalid("Bloom filter geometry differs");
+        for (std::size_t index = 0; index < count_; ++index) {
+            for (std::size_t word = 0; word < block_words; ++word) {
+                const auto bits = other.blocks_[index].words[word].load(std::memory_order_relaxed);
+                if (bits) blocks_[index].words[word].fetch_or(bits, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // bits as plain words, such as to send to another locality
+    auto save() const {
+        std::vector<std::uint64_t> words;
+        words.reserve(count_ * block_words);
+        for (std::size_t index = 0; index < count_; ++index) {
+            for (const auto& word : blocks_[index].words)
+                words.push_back(word.load(std::memory_order_relaxed));
+        }
+        return words;
+    }
+
+    // merges saved words from a filter built with the same sizing
+    void load(const std::vector<std::uint64_t>& words) {
+        if (words.size() != count_ * block_words) throw invalid("Bloom filter geometry differs");
+        for (std::size_t index = 0; index < count_; ++index) {
+            for (std::size_t word = 0; word < block_words; ++word) {
+                const auto bits = words[index * block_words + word];
+                if (bits) blocks_[index].words[word].fetch_or(bits, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    void clear() noexcept {
+        for (std::size_t index = 0; index < count_; ++index) {
+            for (auto& word : blocks_[index].words)
+                word.store(0, std::memory_order_relaxed);
+        }
+    }
+
+private:
+    static constexpr std::size_t block_words = cache_line / sizeof(std::uint64_t);
+    static constexpr std::size_t block_bits = block_words * 64;
+    static constexpr unsigned max_hashes = 16;
+
+    struct alignas(cache_line) block_t {
+        std::atomic<std::uint64_t> words[block_words]{};
+    };
+
+    const std::size_t count_;
+    const unsigned hashes_;
+    std::unique_ptr<block_t[]> blocks_;
+
+    static auto block_count(std::size_t bits) noexcept -> std::size_t {
+        return std::max<std::size_t>(1, (bits + block_bits - 1) / block_bits);
+    }
+
+    // block from the high half of the hash, bits by double hashing the rest
+    auto locate(const K& key, std::uint64_t *mask) const noexcept -> block_t& {
+        const auto hash = atomic::detail::mix_hash(Hash()(key));
+        const auto index = std::size_t((std::uint64_t(std::uint32_t(hash >> 32)) * count_) >> 32);
+        const auto probe = atomic::detail::mix_hash(hash ^ 0x9e3779b97f4a7c15ULL);
+        const auto step = std::uint32_t(probe >> 32) | 1U;
+        auto bit = std::uint32_t(probe);
+        for (unsigned count = 0; count < hashes_; ++count, bit += step)
+            mask[(bit % block_bits) / 64] |= std::uint64_t(1) << (bit % 64);
+        return blocks_[index];
+    }
+};
+
+// HyperLogLog distinct count estimator with 2^P one byte registers, so the
+// footprint is fixed at 2^P bytes regardless of cardinality. Updates only
+// write when a register grows, and sketches merge by register maximum.
+template <typename K, unsigned P = 12, typename Hash = std::hash<K>>
+class hyperloglog_t final {
+public:
+    hyperloglog_t() = default;
+    hyperloglog_t(const hyperloglog_t&) = delete;
+    auto operator=(const hyperloglog_t&) -> auto& = delete;
+
+    auto operator|=(const hyperloglog_t& other) noexcept -> auto& {
+        merge(other);
+        return *this;
+    }
+
+    static constexpr auto registers() noexcept {
+        return count;
+    }
+
+    // true if the estimate may have changed
+    auto insert(const K& key) noexcept {
+        const auto hash = atomic::detail::mix_hash(Hash()(key));
+        const auto rank = std::uint8_t(__builtin_clzll((hash << P) | (std::uint64_t(1) << (P - 1))) + 1);
+        return raise(regs_[hash >> (64 - P)], rank);
+    }
+
+    auto estimate() const noexcept -> double {
+        double sum = 0.0;
+        std::size_t zeros = 0;
+        for (std::size_t index = 0; index < count; ++index) {
+            const auto rank = regs_[index].load(std::memory_order_relaxed);
+            sum += std::ldexp(1.0, -int(rank));
+            if (!rank) ++zeros;
+        }
+
+        const auto size = double(count);
+        const auto raw = alpha() * size * size / sum;
+        if (raw <= 2.5 * size && zeros) return size * std::log(size / double(zeros));
+        return raw;
+    }
+
+    auto size() const noexcept {
+        return std::size_t(std::llround(estimate()));
+    }
+
+    void merge(const hyperloglog_t& other) noexcept {
+        for (std::size_t index = 0; index < count; ++index)
+            raise(regs_[index], other.regs_[index].load(std::memory_order_relaxed));
+    }
+
+    void clear() noexcept {
+        for (std::size_t index = 0; index < count; ++index)
+            regs_[index].store(0, std::memory_order_relaxed);
+    }
+
+private:
+    static_assert(P >= 4 && P <= 18, "Precision must be between 4 and 18");
+
+    static constexpr std::size_t count = std::size_t(1) << P;
+
+    // on the heap, since hpx thread stacks are too small for larger P
+    const std::unique_ptr<std::atomic<std::uint8_t>[]> regs_{new std::atomic<std::uint8_t>[count]()};
+
+    static constexpr auto alpha() noexcept {
+        if constexpr (P == 4) return 0.673;
+        else if constexpr (P == 5) return 0.697;
+        else if constexpr (P == 6) return 0.709;
+        else return 0.7213 / (1.0 + 1.079 / double(count));
+    }
+
+    static auto raise(std::atomic<std::uint8_t>& reg, std::uint8_t rank) noexcept {
+        auto current = reg.load(std::memory_order_relaxed);
+        while (current < rank) {
+            if (reg.compare_exchange_weak(current, rank, std::memory_order_relaxed)) return true;
+        }
+        return false;
+    }
+};
+
+// Count-Min sketch of D rows by W counters. Estimates never undercount, and
+// overcount by at most e / W of the total with probability 1 - e^-D. Insert
+// returns the new estimate so callers can keep their own heavy hitter list.
+template <typename K, std::size_t W = 2048, std::size_t D = 4, typename Hash = std::hash<K>>
+class countmin_t final {
+public:
+    countmin_t() = default;
+    countmin_t(const countmin_t&) = delete;
+    auto operator=(const countmin_t&) -> auto& = delete;
+
+    auto operator|=(const countmin_t& other) noexcept -> auto& {
+        merge(other);
+        return *this;
+    }
+
+    auto insert(const K& key, std::uint64_t amount = 1) noexcept {
+        std::size_t cols[D];
+        columns(key, cols);
+        auto least = ~std::uint64_t(0);
+        for (std::size_t row = 0; row < D; ++row)
+            least = std::min(least, counter(row, cols[row]).fetch_add(amount, std::memory_order_relaxed) + amount);
+        return least;
+    }
+
+    auto estimate(const K& key) const noexcept {
+        std::size_t cols[D];
+        columns(key, cols);
+        auto least = ~std::uint64_t(0);
+        for (std::size_t row = 0; row < D; ++row)
+            least = std::min(least, counter(row, cols[row]).load(std::memory_order_relaxed));
+        return least;
+    }
+
+    // every row sums to the total of all inserts
+    auto total() const noexcept {
+        std::uint64_t sum = 0;
+        for (std::size_t col = 0; col < W; ++col)
+            sum += counter(0, col).load(std::memory_order_relaxed);
+        return sum;
+    }
+
+    void merge(const countmin_t& other) noexcept {
+        for (std::size_t row = 0; row < D; ++row) {
+            for (std::size_t col = 0; col < W; ++col) {
+                const auto value = other.counter(row, col).load(std::memory_order_relaxed);
+                if (value) counter(row, col).fetch_add(value, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    void clear() noexcept {
+        for (std::size_t index = 0; index < D * W; ++index)
+            rows_[index].store(0, std::memory_order_relaxed);
+    }
+
+private:
+    static_assert(util::is_pow2<W>(), "Width must be a power of 2");
+    static_assert(D > 0, "Depth must be positive");
+
+    // D rows of W counters, on the heap as they are too large for hpx stacks
+    const std::unique_ptr<std::atomic<std::uint64_t>[]> rows_{new std::atomic<std::uint64_t>[D * W]()};
+
+    auto counter(std::size_t row, std::size_t col) const noexcept -> std::atomic<std::uint64_t>& {
+        return rows_[row * W + col];
+    }
+
+    static void columns(const K& key, std::size_t *cols) noexcept {
+        const auto hash = atomic::detail::mix_hash(Hash()(key));
+        const auto step = (hash >> 32) | 1U;
+        for (std::size_t row = 0; row < D; ++row)
+            cols[row] = std::size_t((hash + row * step) & (W - 1));
+    }
+};
+} // namespace hitycho::sketch
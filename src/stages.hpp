@@ -0,0 +1,384 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright (C) 2025 David Sugar <tychosoft@gmail.com>
+
+#pragma once
+
+#include "pipeline.hpp"
+
+#include <hpx/execution.hpp>
+#include <hpx/future.hpp>
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace hitycho::system {
+struct stage_options {
+    std::size_t workers{1};
+    bool ordered{false}; // emit in the order items were pulled
+};
+
+struct stage_stats {
+    std::string name;
+    std::size_t workers{0};
+    std::uint64_t items{0};
+    std::uint64_t emitted{0};
+    std::chrono::nanoseconds busy{0};    // running the stage function
+    std::chrono::nanoseconds starved{0}; // waiting on an empty input
+    std::chrono::nanoseconds blocked{0}; // waiting on a full output
+    std::size_t queued{0};               // items waiting in the input
+
+    // share of its workers' time the stage spent doing work
+    auto utilization() const noexcept {
+        const auto total = busy + starved + blocked;
+        return total.count() ? double(busy.count()) / double(total.count()) : 0.0;
+    }
+};
+
+namespace detail {
+template <typename T>
+struct packet_t {
+    bool end{false};
+    T value{};
+};
+
+struct stage_t {
+    const std::string name;
+    const std::size_t workers;
+    std::function<std::size_t()> queued;
+    std::atomic<std::uint64_t> items{0}, emitted{0}, busy{0}, starved{0}, blocked{0};
+
+    stage_t(std::string id, std::size_t count) : name(std::move(id)), workers(count) {}
+};
+
+struct graph_state_t {
+    std::vector<std::unique_ptr<stage_t>> stages;
+    std::vector<std::function<void()>> launch, abort;
+    std::vector<hpx::future<void>> tasks;
+    std::atomic<bool> stopping{false}, aborted{false};
+    hpx::mutex lock;
+    std::exception_ptr failure;
+
+    void cancel() {
+        if (aborted.exchange(true)) return;
+        stopping = true;
+        for (auto& abort_edge : abort)
+            abort_edge();
+    }
+
+    void fail(std::exception_ptr error) {
+        {
+            const std::lock_guard<hpx::mutex> guard(lock);
+            if (!failure) failure = error;
+        }
+        cancel();
+    }
+};
+
+// a typed, bounded edge between stages, closed gracefully with end packets
+template <typename T, std::size_t S>
+struct edge_t {
+    pipeline<packet_t<T>, S> queue;
+    std::atomic<std::size_t> producers{0};
+    std::size_t consumers{0};
+
+    void finished() {
+        if (producers.fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+        for (std::size_t count = 0; count < consumers; ++count)
+            queue.push(packet_t<T>{true, T{}});
+    }
+};
+
+// ordered stages number items as they pull them and emit in that turn
+struct order_t {
+    hpx::mutex pull;
+    std::uint64_t taken{0};
+    std::atomic<std::uint64_t> turn{0};
+    std::atomic<bool> cancelled{false};
+};
+
+inline auto elapsed(std::chrono::steady_clock::time_point from) noexcept -> std::uint64_t {
+    return std::uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - from).count());
+}
+} // namespace detail
+
+// A running stage graph. Destroying it aborts the graph and joins workers.
+// A moved from graph is empty, and its calls do nothing.
+class graph_t final {
+public:
+    graph_t(const graph_t&) = delete;
+    auto operator=(const graph_t&) -> auto& = delete;
+    graph_t(graph_t&&) noexcept = default;
+
+    ~graph_t() {
+        if (!state_) return;
+        close();
+        join();
+    }
+
+    // abort at once, dropping queued items
+    void close() {
+        if (!state_) return;
+        state_->cancel();
+    }
+
+    // stop the sources and wait until everything in flight has drained
+    void drain() {
+        if (!state_) return;
+        state_->stopping = true;
+        wait();
+    }
+
+    // wait for the sources to finish and the graph to drain
+    void wait() {
+        if (!state_) return;
+        join();
+        const std::lock_guard<hpx::mutex> guard(state_->lock);
+        if (state_->failure) std::rethrow_exception(std::exchange(state_->failure, nullptr));
+    }
+
+    auto stats() const {
+        std::vector<stage_stats> list;
+        if (!state_) return list;
+        for (const auto& stage : state_->stages) {
+            list.push_back(stage_stats{
+            stage->name,
+            stage->workers,
+            stage->items.load(std::memory_order_relaxed),
+            stage->emitted.load(std::memory_order_relaxed),
+            std::chrono::nanoseconds(stage->busy.load(std::memory_order_relaxed)),
+            std::chrono::nanoseconds(stage->starved.load(std::memory_order_relaxed)),
+            std::chrono::nanoseconds(stage->blocked.load(std::memory_order_relaxed)),
+            stage->queued ? stage->queued() : 0});
+        }
+        return list;
+    }
+
+    // the stage whose workers spend the largest share of time busy
+    auto bottleneck() const {
+        std::string name;
+        auto highest = -1.0;
+        for (const auto& stage : stats()) {
+            if (stage.utilization() > highest) {
+                highest = stage.utilization();
+                name = stage.name;
+            }
+        }
+        return name;
+    }
+
+private:
+    template <typename, std::size_t>
+    friend class flow_t;
+
+    std::shared_ptr<detail::graph_state_t> state_;
+
+    explicit graph_t(std::shared_ptr<detail::graph_state_t> state) : state_(std::move(state)) {
+        for (auto& launch : state_->launch)
+            launch();
+    }
+
+    void join() {
+        for (auto& task : state_->tasks) {
+            if (task.valid()) task.get();
+        }
+    }
+};
+
+// Builder for a linear graph of stages joined by bounded pipelines of S
+// packets. Each stage runs its own workers on an hpx executor. Nothing runs
+// until a sink completes the graph.
+template <typename T, std::size_t S = 64>
+class flow_t final {
+public:
+    // gen returns std::optional<T>, and the source ends on std::nullopt.
+    // Workers share the one generator, calling it one at a time.
+    template <typename Gen, typename Executor = hpx::execution::parallel_executor>
+    static auto source(std::string name, Gen gen, stage_options opts = {}, Executor exec = {}) {
+        struct shared_t {
+            explicit shared_t(Gen from) : gen(std::move(from)) {}
+            hpx::mutex lock;
+            Gen gen;
+            bool ended{false};
+        };
+
+        auto state = std::make_shared<detail::graph_state_t>();
+        auto out = make_edge(*state, opts.workers);
+        auto stage = add_stage(*state, std::move(name), opts.workers, nullptr);
+        auto graph = state.get();
+        auto shared = std::make_shared<shared_t>(std::move(gen));
+        state->launch.push_back([graph, stage, out, shared, opts, exec] {
+            for (std::size_t worker = 0; worker < opts.workers; ++worker) {
+                graph->tasks.push_back(hpx::async(exec, [graph, stage, out, shared] {
+                    try {
+                        while (!graph->stopping) {
+                            auto started = std::chrono::steady_clock::now();
+                            std::optional<T> item;
+                            {
+                                const std::lock_guard<hpx::mutex> guard(shared->lock);
+                                if (!shared->ended) item = shared->gen();
+                                shared->ended = !item;
+                            }
+                            stage->busy += detail::elapsed(started);
+                            if (!item) break;
+                            ++stage->items;
+                            started = std::chrono::steady_clock::now();
+                            const auto pushed = out->queue.push(detail::packet_t<T>{false, std::move(*item)});
+                            stage->blocked += detail::elapsed(started);
+                            if (!pushed) break;
+                            ++stage->emitted;
+                        }
+                    } catch (...) {
+                        graph->fail(std::current_exception());
+                    }
+                    out->finished();
+                }));
+            }
+        });
+        return flow_t(std::move(state), std::move(out));
+    }
+
+    template <typename Func, typename Executor = hpx::execution::parallel_executor>
+    auto map(std::string name, Func func, stage_options opts = {}, Executor exec = {}) {
+        using U = std::invoke_result_t<Func, T&&>;
+        return attach<U>(std::move(name), opts, exec, [func](T&& item, std::vector<U>& outs) mutable {
+            outs.push_back(func(std::move(item)));
+        });
+    }
+
+    template <typename Pred, typename Executor = hpx::execution::parallel_executor>
+    auto filter(std::string name, Pred pred, stage_options opts = {}, Executor exec = {}) {
+        return attach<T>(std::move(name), opts, exec, [pred](T&& item, std::vector<T>& outs) mutable {
+            if (pred(static_cast<const T&>(item))) outs.push_back(std::move(item));
+        });
+    }
+
+    // func returns a container, each element of which is emitted
+    template <typename Func, typename Executor = hpx::execution::parallel_executor>
+    auto flat_map(std::string name, Func func, stage_options opts = {}, Executor exec = {}) {
+        using U = typename std::invoke_result_t<Func, T&&>::value_type;
+        return attach<U>(std::move(name), opts, exec, [func](T&& item, std::vector<U>& outs) mutable {
+            for (auto& value : func(std::move(item)))
+                outs.push_back(std::move(value));
+        });
+    }
+
+    template <typename Func, typename Executor = hpx::execution::parallel_executor>
+    auto sink(std::string name, Func func, stage_options opts = {}, Executor exec = {}) {
+        run<void>(std::move(name), opts, exec, nullptr, [func](T&& item, std::vector<char>&) mutable {
+            func(std::move(item));
+        });
+        return graph_t(std::move(state_));
+    }
+
+private:
+    template <typename, std::size_t>
+    friend class flow_t;
+
+    std::shared_ptr<detail::graph_state_t> state_;
+    std::shared_ptr<detail::edge_t<T, S>> edge_;
+
+    flow_t(std::shared_ptr<detail::graph_state_t> state, std::shared_ptr<detail::edge_t<T, S>> edge) : state_(std::move(state)), edge_(std::move(edge)) {}
+
+    template <typename U>
+    static auto make_edge(detail::graph_state_t& state, std::size_t producers) {
+        auto edge = std::make_shared<detail::edge_t<U, S>>();
+        edge->producers = producers;
+        state.abort.push_back([edge] { edge->queue.close(); });
+        return edge;
+    }
+
+    static auto make_edge(detail::graph_state_t& state, std::size_t producers) {
+        return make_edge<T>(state, producers);
+    }
+
+    static auto add_stage(detail::graph_state_t& state, std::string name, std::size_t workers, std::function<std::size_t()> queued) {
+        if (!workers) throw invalid("Stage needs at least one worker");
+        state.stages.push_back(std::make_unique<detail::stage_t>(std::move(name), workers));
+        auto stage = state.stages.back().get();
+        stage->queued = std::move(queued);
+        return stage;
+    }
+
+    template <typename U, typename Executor, typename Body>
+    auto attach(std::string name, stage_options opts, Executor exec, Body body) {
+        auto out = flow_t<U, S>::template make_edge<U>(*state_, opts.workers);
+        run<U>(std::move(name), opts, exec, out, std::move(body));
+        return flow_t<U, S>(state_, std::move(out));
+    }
+
+    // spawn the workers of a stage; body fills outs from each input item
+    template <typename U, typename Executor, typename Out, typename Body>
+    void run(std::string name, stage_options opts, Executor exec, Out out, Body body) {
+        auto in = edge_;
+        in->consumers = opts.workers;
+        auto stage = add_stage(*state_, std::move(name), opts.workers, [in] { return in->queue.count(); });
+        auto order = std::make_shared<detail::order_t>();
+        state_->abort.push_back([order] {
+            order->cancelled = true;
+            atomic::detail::unpark(&order->turn);
+        });
+
+        auto graph = state_.get();
+        state_->launch.push_back([graph, stage, in, out, order, body, opts, exec] {
+            for (std::size_t worker = 0; worker < opts.workers; ++worker) {
+                graph->tasks.push_back(hpx::async(exec, [graph, stage, in, out, order, body, ordered = opts.ordered]() mutable {
+                    using item_t = std::conditional_t<std::is_void_v<U>, char, U>;
+                    std::vector<item_t> outs;
+                    detail::packet_t<T> packet;
+                    try {
+                        for (;;) {
+                            auto started = std::chrono::steady_clock::now();
+                            std::uint64_t ticket = 0;
+                            if (ordered) {
+                                const std::lock_guard<hpx::mutex> guard(order->pull);
+                                if (!in->queue.pull(packet) || packet.end) break;
+                                ticket = order->taken++;
+                            } else if (!in->queue.pull(packet) || packet.end)
+                                break;
+                            stage->starved += detail::elapsed(started);
+
+                            started = std::chrono::steady_clock::now();
+                            outs.clear();
+                            body(std::move(packet.value), outs);
+                            stage->busy += detail::elapsed(started);
+                            ++stage->items;
+
+                            started = std::chrono::steady_clock::now();
+                            if (ordered) {
+                                atomic::detail::park(&order->turn, [&order, ticket] {
+                                    return order->cancelled || order->turn.load(std::memory_order_acquire) == ticket;
+                                });
+                                if (order->cancelled) break;
+                            }
+
+                            auto pushed = true;
+                            if constexpr (!std::is_void_v<U>) {
+                                for (auto& value : outs) {
+                                    if (!(pushed = out->queue.push(detail::packet_t<U>{false, std::move(value)}))) break;
+                                }
+                            }
+
+                            if (ordered) {
+                                order->turn.store(ticket + 1, std::memory_order_release);
+                                atomic::detail::unpark(&order->turn);
+                            }
+                            stage->blocked += detail::elapsed(started);
+                            stage->emitted += outs.size();
+                            if (!pushed) break;
+                        }
+                    } catch (...) {
+                        graph->fail(std::current_exception());
+                    }
+                    if constexpr (!std::is_void_v<U>)
+                        out->finished();
+                }));
+            }
+        });
+    }
+};
+} // namespace hitycho::system
@@ -14,6 +14,10 @@
 #include <sys/time.h>
 #include <sys/stat.h>
 
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
+
 #include <hpx/hpx_init.hpp>
 
 namespace hitycho::system {
@@ -106,6 +110,15 @@ inline auto make_argv(const args_t& args) {
     return argv;
 }
 
+// numa node of the cpu the calling thread is running on, or -1 if unknown
+inline auto numa_node() noexcept -> int {
+#if defined(__linux__) && defined(SYS_getcpu)
+    unsigned cpu = 0, node = 0;
+    if (::syscall(SYS_getcpu, &cpu, &node, nullptr) == 0) return int(node);
+#endif
+    return -1;
+}
+
 inline void time_of_day(struct timeval *tp) noexcept {
     gettimeofday(tp, nullptr);
 }
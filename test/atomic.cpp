@@ -5,9 +5,17 @@
 #include "system.hpp"
 #include "atomic.hpp"
 
+#include <algorithm>
+#include <iterator>
+#include <list>
+#include <thread>
+#include <vector>
+
 using namespace hitycho;
 
 namespace {
+std::atomic<int> released{0};
+
 void test_atomic_once() {
     const atomic::once_t once;
     assert(is(once));
@@ -21,6 +29,42 @@ void test_atomic_sequence() {
     assert(static_cast<uint8_t>(bytes) == 4);
 }
 
+void test_atomic_sharded_sequence() {
+    atomic::sharded_sequence_t<std::uint64_t, 64> ids(100);
+    auto first = *ids;
+    assert(first >= 100);
+    assert(*ids == first + 1);
+
+    atomic::sharded_sequence_t<unsigned, 8, true> ordered(5);
+    assert(*ordered == 5);
+    assert(ordered.next() == 6);
+
+    std::vector<hpx::future<std::vector<std::uint64_t>>> tasks;
+    for (auto worker = 0; worker < 4; ++worker) {
+        tasks.push_back(hpx::async([&ids] {
+            std::vector<std::uint64_t> list;
+            for (auto count = 0; count < 500; ++count)
+                list.push_back(*ids);
+            return list;
+        }));
+    }
+    std::vector<std::uint64_t> all;
+    for (auto& task : tasks) {
+        auto list = task.get();
+        all.insert(all.end(), list.begin(), list.end());
+    }
+    std::sort(all.begin(), all.end());
+    assert(std::adjacent_find(all.begin(), all.end()) == all.end());
+
+    std::size_t most = 0;
+    for (auto count = 0; count < 200; ++count) { // ids of exited threads reused
+        std::thread([&most] {
+            most = std::max(most, atomic::detail::worker_id());
+        }).join();
+    }
+    assert(most < 64);
+}
+
 void test_atomic_dictionary() {
     atomic::dictionary_t<int, std::string> dict;
     dict.insert_or_assign(1, "one");
@@ -31,12 +75,460 @@ void test_atomic_dictionary() {
     dict.remove(1);
     assert(!dict.contains(1));
     assert(dict.size() == 1);
-    dict.each([](const int& key, std::string& value) {
+    dict.each([](const int& key, const std::string& value) {
         assert(key == 2);
         assert(value == "two");
-        value = "two two";
     });
-    assert(dict.find(2).value() == "two two"); // NOLINT
+    dict.insert_or_assign(2, "two two");
+    assert(dict.at(2) == "two two");
+    assert(dict[2] == "two two");
+}
+
+void test_atomic_dictionary_unique() {
+    atomic::dictionary_t<int, int, 4> dict;
+    std::atomic<int> placed{0};
+    std::vector<hpx::future<void>> tasks;
+    for (auto task = 0; task < 4; ++task) {
+        tasks.push_back(hpx::async([&dict, &placed, task] {
+            for (auto key = 0; key < 200; ++key) {
+                if (dict.try_emplace(int(key), int(task)))
+                    ++placed;
+                dict.insert_or_assign(key + 1000, task);
+            }
+        }));
+    }
+    for (auto& task : tasks)
+        task.get();
+
+    assert(placed == 200);
+    assert(dict.size() == 400);
+    std::vector<int> keys;
+    dict.keys_into(keys);
+    std::sort(keys.begin(), keys.end());
+    assert(std::adjacent_find(keys.begin(), keys.end()) == keys.end());
+}
+
+void test_atomic_dictionary_bulk() {
+    atomic::dictionary_t<int, int, 64> dict;
+    for (auto key = 1; key <= 1000; ++key)
+        dict.insert(key, key * 2);
+
+    std::atomic<int> visited{0};
+    dict.for_each_par(hpx::execution::par, [&visited](const int& key, const int& value) {
+        assert(value == key * 2);
+        ++visited;
+    });
+    assert(visited == 1000);
+
+    const auto total = dict.transform_reduce(hpx::execution::par, 0L, std::plus<>(), [](const int&, const int& value) {
+        return long(value);
+    });
+    assert(total == 1000L * 1001L);
+
+    std::vector<int> keys;
+    assert(dict.keys_into(keys) == 1000);
+    auto items = dict.snapshot();
+    assert(items.size() == 1000);
+    std::sort(items.begin(), items.end());
+    assert(items.front().first == 1 && items.front().second == 2);
+}
+
+void test_atomic_epoch() {
+    atomic::epoch_t domain;
+    {
+        const atomic::epoch_guard guard(domain);
+        domain.retire(new int(1), [](void *ptr) {
+            delete static_cast<int *>(ptr);
+            ++released;
+        });
+        assert(domain.pending() == 1);
+        domain.collect();
+        assert(!domain.collect());
+        assert(released == 0);
+    }
+    domain.synchronize([] { hpx::this_thread::yield(); });
+    assert(released == 1);
+    assert(domain.pending() == 0);
+}
+
+void test_atomic_rcu() {
+    atomic::rcu_ptr<std::vector<int>> table(new std::vector<int>{1, 2, 3});
+    {
+        const auto reader = table.read();
+        assert(reader->size() == 3);
+        table.update([](std::vector<int>& next) { next.push_back(4); });
+        assert(reader->size() == 3);
+    }
+    assert(table.read()->size() == 4);
+
+    std::vector<hpx::future<void>> tasks;
+    for (auto worker = 0; worker < 4; ++worker) {
+        tasks.push_back(hpx::async([&table] {
+            for (auto count = 0; count < 100; ++count) {
+                table.update([](std::vector<int>& next) { next.push_back(int(next.size()) + 1); });
+                const auto reader = table.read();
+                assert(reader->back() == int(reader->size()));
+            }
+        }));
+    }
+    for (auto& task : tasks)
+        task.get();
+    assert(table.read()->size() == 404);
+
+    table.emplace(std::vector<int>{7});
+    table.synchronize([] { hpx::this_thread::yield(); });
+    assert(table.read()->front() == 7);
+}
+
+void test_atomic_deque() {
+    atomic::deque_t<int> deque(4);
+    for (auto count = 0; count < 10; ++count)
+        deque.push_bottom(count);
+    assert(deque.size() == 10);
+    assert(deque.capacity() >= 16);
+    assert(deque.pop_bottom().value() == 9); // NOLINT
+    assert(deque.steal().value() == 0);      // NOLINT
+
+    std::atomic<int> total{0};
+    std::vector<hpx::future<void>> thieves;
+    for (auto worker = 0; worker < 3; ++worker) {
+        thieves.push_back(hpx::async([&deque, &total] {
+            for (auto count = 0; count < 200; ++count) {
+                auto item = deque.steal();
+                if (item)
+                    total += *item;
+                hpx::this_thread::yield();
+            }
+        }));
+    }
+    for (auto count = 10; count < 1000; ++count)
+        deque.push_bottom(count);
+    for (auto& thief : thieves)
+        thief.get();
+    while (auto item = deque.pop_bottom())
+        total += *item;
+    assert(total == 499500 - 9 - 0);
+    assert(deque.stats().steals >= 1);
+}
+
+void test_atomic_hashmap() {
+    atomic::hashmap_t<int, std::string> map;
+    assert(map.insert(1, "one"));
+    assert(!map.insert(1, "uno"));
+    assert(!map.insert_or_assign(1, "uno"));
+    assert(map.find(1).value() == "uno"); // NOLINT
+    assert(map.remove(1));
+    assert(!map.contains(1));
+
+    for (auto key = 0; key < 10000; ++key)
+        assert(map.insert(key, std::to_string(key)));
+    assert(map.size() == 10000);
+    assert(map.bucket_count() >= 4096);
+    assert(map.load_factor() <= 2.0);
+    assert(map.at(4321) == "4321");
+
+    std::vector<hpx::future<void>> tasks;
+    for (auto worker = 0; worker < 4; ++worker) {
+        tasks.push_back(hpx::async([&map, worker] {
+            for (auto key = worker; key < 10000; key += 4)
+                assert(map.remove(key));
+        }));
+    }
+    for (auto& task : tasks)
+        task.get();
+    assert(map.empty());
+    assert(map.keys().empty());
+}
+
+void test_atomic_skiplist() {
+    atomic::skiplist_t<int, std::string> list;
+    assert(list.insert(30, "thirty"));
+    assert(list.insert(10, "ten"));
+    assert(list.insert(20, "twenty"));
+    assert(!list.insert(20, "again"));
+    assert(list.size() == 3);
+    assert(list.find(20).value() == "twenty"); // NOLINT
+    assert(list.lower_bound(15).value().first == 20); // NOLINT
+    assert(!list.lower_bound(31));
+
+    std::vector<int> keys;
+    for (const auto& [key, value] : list.range(10, 30))
+        keys.push_back(key);
+    assert((keys == std::vector<int>{10, 20}));
+
+    assert(list.erase(10));
+    assert(!list.erase(10));
+    assert(list.pop_min().value().second == "twenty"); // NOLINT
+    assert(list.size() == 1);
+
+    atomic::skiplist_t<int, int> shared;
+    std::vector<hpx::future<void>> tasks;
+    for (auto worker = 0; worker < 4; ++worker) {
+        tasks.push_back(hpx::async([&shared, worker] {
+            for (auto count = 0; count < 1000; ++count) {
+                const auto key = (count * 4) + worker;
+                assert(shared.insert(key, key));
+                if (count % 2) assert(shared.erase(key - 4));
+            }
+        }));
+    }
+    for (auto& task : tasks)
+        task.get();
+    assert(shared.size() == 2000);
+    auto last = -1;
+    shared.each([&last](const int& key, const int& value) {
+        assert(key == value && key > last);
+        last = key;
+    });
+
+    std::size_t popped = 0;
+    while (shared.pop_min())
+        ++popped;
+    assert(popped == 2000 && shared.empty());
+}
+
+void test_atomic_flatmap() {
+    atomic::flatmap_t<std::uint64_t, std::uint32_t> flows(1000);
+    assert(flows.capacity() >= 1000);
+    assert(flows.insert(7, 70));
+    assert(!flows.insert(7, 71));
+    assert(!flows.insert_or_assign(7, 77));
+    assert(flows.find(7).value() == 77); // NOLINT
+    assert(flows.remove(7));
+    assert(!flows.contains(7));
+
+    std::vector<hpx::future<void>> tasks;
+    for (auto worker = 0U; worker < 4; ++worker) {
+        tasks.push_back(hpx::async([&flows, worker] {
+            for (auto key = worker; key < 800; key += 4)
+                assert(flows.insert(key, key * 2));
+        }));
+        tasks.push_back(hpx::async([&flows] {
+            for (auto key = 0U; key < 800; ++key) {
+                auto value = flows.find(key);
+                assert(!value || *value == key * 2);
+            }
+        }));
+    }
+    for (auto& task : tasks)
+        task.get();
+    assert(flows.size() == 800);
+    for (auto key = 0U; key < 800; key += 2)
+        assert(flows.remove(key));
+    assert(flows.size() == 400 && flows.contains(401) && !flows.contains(400));
+
+    atomic::flatmap_t<std::uint32_t, std::uint32_t> tiny(1);
+    auto key = 0U;
+    while (tiny.size() < tiny.capacity())
+        assert(tiny.insert(key++, 0));
+    assert(!tiny.insert(0, 1));
+    auto thrown = false;
+    try {
+        tiny.insert(key, 0);
+    } catch (const overflow&) {
+        thrown = true;
+    }
+    assert(thrown);
+
+    atomic::flatmap_t<std::uint32_t, std::uint32_t> crowded(48); // probe chains overlap
+    for (auto fill = 0U; fill < 60; ++fill)
+        crowded.insert(1000 + fill, 0);
+    tasks.clear();
+    for (auto worker = 0U; worker < 4; ++worker) {
+        tasks.push_back(hpx::async([&crowded, worker] {
+            for (auto round = 0U; round < 20000; ++round) {
+                const auto key = worker * 8 + round % 8;
+                crowded.insert_or_assign(key, round);
+                crowded.remove(key);
+            }
+        }));
+    }
+    for (auto& task : tasks)
+        task.get();
+    assert(crowded.size() == 60);
+
+    atomic::flatmap_t<std::uint32_t, std::uint32_t> churned(1); // one group, rebuilt
+    for (auto key = 0U; key < 10; ++key)
+        churned.insert(key, key);
+    std::atomic<bool> churning{true};
+    auto reader = hpx::async([&churned, &churning] {
+        while (churning) {
+            for (auto key = 0U; key < 10; ++key)
+                assert(churned.find(key).value_or(~0U) == key);
+        }
+    });
+    for (auto round = 0U; round < 2000; ++round) {
+        for (auto key = 100U; key < 106; ++key)
+            assert(churned.insert(key, round));
+        for (auto key = 100U; key < 106; ++key)
+            assert(churned.remove(key));
+    }
+    churning = false;
+    reader.get();
+    assert(churned.size() == 10 && !churned.contains(100));
+
+    atomic::flatmap_t<std::uint32_t, std::uint32_t> single(1); // full group leaves tombstones
+    for (auto key = 0U; key < single.capacity(); ++key)
+        assert(single.insert(key, key));
+    for (auto key = 0U; key < 6; ++key)
+        assert(single.remove(key));
+    for (auto key = 0U; key < single.capacity(); ++key)
+        assert(single.contains(key) == (key >= 6));
+    assert(single.insert(100, 1) && single.find(100).value_or(0) == 1);
+}
+
+void test_atomic_buffer() {
+    atomic::buffer_t<int, 4> buf;
+    assert(buf.push(1));
+    assert(buf.push(2));
+    assert(buf.pop().value() == 1); // NOLINT
+    int item{0};
+    assert(buf.pull(item) && item == 2);
+    assert(buf.empty());
+
+    std::atomic<bool> running{true};
+    auto observer = hpx::async([&buf, &running] {
+        while (running)
+            assert(buf.size() <= 4);
+    });
+    auto consumer = hpx::async([&buf] {
+        int value{0};
+        for (auto count = 0; count < 20000;) {
+            if (buf.pull(value)) ++count;
+        }
+    });
+    for (auto count = 0; count < 20000;) {
+        if (buf.push(count)) ++count;
+    }
+    consumer.get();
+    running = false;
+    observer.get();
+}
+
+void test_atomic_ring() {
+    atomic::ring_t<std::unique_ptr<int>, 4> ring;
+    assert(ring.try_push(std::make_unique<int>(1)));
+    assert(ring.try_push(std::make_unique<int>(2)));
+    assert(ring.size() == 2);
+    assert(*ring.pop().value() == 1); // NOLINT
+
+    std::vector<std::unique_ptr<int>> items;
+    for (auto pos = 3; pos < 7; ++pos)
+        items.push_back(std::make_unique<int>(pos));
+    assert(ring.push_n(items.begin(), items.size()) == 3);
+    assert(ring.full());
+
+    std::vector<std::unique_ptr<int>> out;
+    assert(ring.pop_n(std::back_inserter(out), 8) == 4);
+    assert(*out[0] == 2 && *out[3] == 5);
+    assert(ring.empty());
+
+    struct limited_t {
+        std::vector<std::unique_ptr<int>> *items;
+        auto operator*() -> auto& { return *this; }
+        auto operator++() -> auto& { return *this; }
+        auto operator=(std::unique_ptr<int>&& item) -> auto& {
+            if (items->size() == 2) throw std::length_error("output full");
+            items->push_back(std::move(item));
+            return *this;
+        }
+    };
+
+    for (auto pos = 0; pos < 4; ++pos)
+        assert(ring.try_push(std::make_unique<int>(pos)));
+    out.clear();
+    auto thrown = false;
+    try {
+        ring.pop_n(limited_t{&out}, 4);
+    } catch (const std::length_error&) {
+        thrown = true;
+    }
+    assert(thrown && out.size() == 2);
+    assert(ring.empty());
+    assert(ring.try_push(std::make_unique<int>(9)) && ring.size() == 1);
+
+    atomic::ring_t<int, 64> shared;
+    std::atomic<int> total{0};
+    std::vector<hpx::future<void>> tasks;
+    for (auto worker = 0; worker < 4; ++worker) {
+        tasks.push_back(hpx::async([&shared] {
+            for (auto count = 1; count <= 100; ++count) {
+                while (!shared.try_push(count))
+                    hpx::this_thread::yield();
+            }
+        }));
+        tasks.push_back(hpx::async([&shared, &total] {
+            for (auto count = 0; count < 100; ++count) {
+                int item{0};
+                while (!shared.try_pop(item))
+                    hpx::this_thread::yield();
+                total += item;
+            }
+        }));
+    }
+    for (auto& task : tasks)
+        task.get();
+    assert(total == 4 * 5050);
+}
+
+void test_atomic_lifo() {
+    atomic::lifo_t<std::string> stack;
+    assert(stack.empty());
+    assert(stack.push("one"));
+    assert(stack.push("two"));
+    assert(stack.size() == 2);
+    assert(stack.pop().value() == "two"); // NOLINT
+    std::string item;
+    assert(stack.pull(item) && item == "one");
+    assert(!stack.pop());
+
+    atomic::lifo_t<int> shared(32);
+    assert(shared.capacity() >= 32);
+    std::vector<hpx::future<void>> tasks;
+    for (auto worker = 0; worker < 8; ++worker) {
+        tasks.push_back(hpx::async([&shared] {
+            for (auto count = 0; count < 1000; ++count) {
+                assert(shared.push(count));
+                assert(shared.size() <= 8);
+                while (!shared.pop())
+                    hpx::this_thread::yield();
+            }
+        }));
+    }
+    for (auto& task : tasks)
+        task.get();
+    assert(shared.empty());
+    assert(shared.size() == 0);
+}
+
+void test_atomic_pool() {
+    atomic::pool_t<std::string> pool(100);
+    assert(pool.capacity() >= 100);
+    auto item = pool.make("hello");
+    assert(item && *item == "hello");
+    auto raw = item.release();
+    assert(!item);
+    pool.destroy(raw);
+
+    std::vector<hpx::future<void>> tasks;
+    for (auto worker = 0; worker < 8; ++worker) {
+        tasks.push_back(hpx::async([&pool, worker] {
+            std::vector<atomic::pool_t<std::string>::handle_t> held;
+            for (auto count = 0; count < 500; ++count) {
+                held.push_back(pool.make(std::to_string(worker)));
+                if (held.size() > 40) held.clear();
+            }
+            for (const auto& entry : held)
+                assert(*entry == std::to_string(worker));
+        }));
+    }
+    for (auto& task : tasks)
+        task.get();
+
+    std::list<int, atomic::pool_allocator<int>> list;
+    for (auto count = 0; count < 100; ++count)
+        list.push_back(count);
+    assert(list.size() == 100 && list.back() == 99);
 }
 
 void test_atomic_refs() {
@@ -57,14 +549,54 @@ void test_atomic_refs() {
     assert(ref.compare_exchange_strong(expected, 99));
     assert(ref == 99);
 }
+
+void test_atomic_wait() {
+    int flag = 0;
+    auto waiter = hpx::async([&flag] {
+        const atomic_ref<int> ref(flag);
+        ref.wait(0);
+        return ref.load();
+    });
+    hpx::this_thread::sleep_for(std::chrono::milliseconds(20));
+    const atomic_ref<int> ref(flag);
+    ref.store(1);
+    ref.notify_one();
+    assert(waiter.get() == 1);
+
+    atomic::sequence_t<unsigned> seq;
+    auto counter = hpx::async([&seq] {
+        seq.wait(0);
+        seq.wait(1);
+        return true;
+    });
+    *seq;
+    seq.notify_all();
+    *seq;
+    seq.notify_all();
+    assert(counter.get());
+}
 } // end namespace
 
 // cppcheck-suppress constParameterReference
 auto hpx_main(hpx::program_options::variables_map& args) -> int { // NOLINT
     test_atomic_once();
     test_atomic_sequence();
+    test_atomic_sharded_sequence();
     test_atomic_dictionary();
+    test_atomic_dictionary_unique();
+    test_atomic_dictionary_bulk();
+    test_atomic_epoch();
+    test_atomic_rcu();
+    test_atomic_deque();
+    test_atomic_hashmap();
+    test_atomic_skiplist();
+    test_atomic_flatmap();
+    test_atomic_buffer();
+    test_atomic_ring();
+    test_atomic_lifo();
+    test_atomic_pool();
     test_atomic_refs();
+    test_atomic_wait();
     return hpx::finalize();
 }
 
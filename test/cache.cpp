@@ -0,0 +1,104 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright (C) 2025 David Sugar <tychosoft@gmail.com>
+
+#undef NDEBUG
+#include "system.hpp"
+#include "cache.hpp"
+
+#include <string>
+#include <vector>
+
+using namespace hitycho;
+
+namespace {
+void test_cache_clock() {
+    atomic::cache_t<int, std::string, 1> cache(3);
+    cache.put(1, "one");
+    cache.put(2, "two");
+    cache.put(3, "three");
+    assert(cache.get(1).value() == "one"); // NOLINT
+    cache.put(4, "four");                  // evicts an unreferenced entry
+    assert(cache.size() == 3);
+    assert(cache.contains(1));
+    assert(cache.contains(4));
+    assert(cache.remove(4));
+    assert(!cache.get(4));
+    cache.clear();
+    assert(cache.empty());
+}
+
+void test_cache_cost() {
+    atomic::cache_t<int, int, 1> cache(100, 10);
+    cache.put(1, 1, 4);
+    cache.put(2, 2, 4);
+    cache.put(3, 3, 4);
+    assert(cache.cost() <= 10);
+    assert(cache.size() == 2);
+
+    atomic::cache_t<int, int, 1> grown(100, 10);
+    grown.put(1, 1, 4);
+    grown.put(2, 2, 4);
+    grown.put(1, 10, 8); // update over the limit evicts the other entry
+    assert(grown.get(1).value() == 10); // NOLINT
+    assert(!grown.get(2));
+    grown.put(3, 3, 20); // too costly for the shard, so kept alone
+    assert(grown.get(3).value() == 3); // NOLINT
+    assert(grown.size() == 1);
+}
+
+void test_cache_ttl() {
+    atomic::cache_t<int, int> cache(16, 0, std::chrono::milliseconds(50));
+    cache.put(1, 10);
+    assert(cache.get(1).value() == 10); // NOLINT
+    hpx::this_thread::sleep_for(std::chrono::milliseconds(100));
+    assert(!cache.get(1));
+}
+
+void test_cache_capacity() {
+    atomic::cache_t<int, int> cache(20);
+    for (auto key = 0; key < 1000; ++key) {
+        cache.put(key, key);
+        assert(cache.size() <= 20);
+    }
+
+    auto thrown = false;
+    try {
+        const atomic::cache_t<int, int> small(10);
+    } catch (const invalid&) {
+        thrown = true;
+    }
+    assert(thrown);
+}
+
+void test_cache_loader() {
+    atomic::cache_t<int, int> cache(64);
+    std::atomic<int> loads{0};
+    std::vector<hpx::future<int>> tasks;
+    for (auto count = 0; count < 8; ++count) {
+        tasks.push_back(hpx::async([&cache, &loads] {
+            return cache.get_or_load(7, [&loads](const int& key) {
+                ++loads;
+                hpx::this_thread::sleep_for(std::chrono::milliseconds(50));
+                return key * 6;
+            });
+        }));
+    }
+    for (auto& task : tasks)
+        assert(task.get() == 42);
+    assert(loads == 1);
+}
+} // end namespace
+
+// cppcheck-suppress constParameterReference
+auto hpx_main(hpx::program_options::variables_map& args) -> int { // NOLINT
+    test_cache_clock();
+    test_cache_cost();
+    test_cache_ttl();
+    test_cache_capacity();
+    test_cache_loader();
+    return hpx::finalize();
+}
+
+auto main(int argc, char *argv[]) -> int {
+    return hpx::init(argc, argv);
+}
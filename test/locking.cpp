@@ -14,12 +14,19 @@ struct test {
     // int v2{7};
 };
 
+struct limits {
+    long low{0};
+    long high{0};
+    double rate{0.0};
+};
+
 namespace {
 lock::exclusive<std::unordered_map<std::string, std::string>> mapper;
 lock::exclusive<int> counter(3);
 lock::shared<std::unordered_map<std::string, std::string>> tshared;
 lock::shared<struct test> testing;
 lock::shared<std::array<int, 10>> tarray;
+lock::seqlock<limits> tlimits;
 } // namespace
 
 // cppcheck-suppress constParameterReference
@@ -64,6 +71,19 @@ auto hpx_main(hpx::program_options::variables_map& args) -> int { // NOLINT
         }
         const reader_ptr<struct test> tester(testing);
         assert(tester->v1 == 3);
+
+        auto writer = hpx::async([] {
+            for (long count = 1; count <= 1000; ++count)
+                tlimits = limits{count, count * 2, double(count)};
+        });
+        for (auto count = 0; count < 1000; ++count) {
+            const limits current = tlimits;
+            assert(current.high == current.low * 2 && current.rate == double(current.low));
+        }
+        writer.get();
+        tlimits.modify([](limits& current) { ++current.low; });
+        assert(tlimits.load().low == 1001);
+        assert(tlimits.version() == 1002);
     } catch (...) {
         hpx::finalize();
         std::quick_exit(-1);
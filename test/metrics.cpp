@@ -0,0 +1,67 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright (C) 2025 David Sugar <tychosoft@gmail.com>
+
+#undef NDEBUG
+#include "system.hpp"
+#include "metrics.hpp"
+
+#include <vector>
+
+using namespace hitycho;
+
+namespace {
+void test_metrics_histogram() {
+    metrics::histogram_t<> latency;
+    assert(latency.empty() && latency.percentile(50) == 0);
+    std::vector<hpx::future<void>> tasks;
+    for (auto worker = 0; worker < 4; ++worker) {
+        tasks.push_back(hpx::async([&latency, worker] {
+            for (std::uint64_t value = worker + 1; value <= 10000; value += 4)
+                latency.record(value * 1000);
+        }));
+    }
+    for (auto& task : tasks)
+        task.get();
+
+    assert(latency.count() == 10000);
+    assert(latency.min() == 1000);
+    const auto median = latency.percentile(50);
+    assert(median >= 5000000 && median <= 5000000 + 5000000 / 64);
+    const auto p99 = latency.percentile(99);
+    assert(p99 >= 9900000 && p99 <= 9900000 + 9900000 / 64);
+    assert(latency.max() >= 10000000);
+
+    metrics::histogram_t<> other;
+    other.record(std::uint64_t(1) << 50);
+    latency |= other;
+    assert(latency.count() == 10001);
+    assert(latency.percentile(100) >= std::uint64_t(1) << 43);
+    latency.reset();
+    assert(latency.empty());
+
+    metrics::histogram_t<16, 1> precise; // shards live on the heap
+    precise.record(123456);
+    assert(precise.percentile(50) - 123456 <= 1);
+}
+
+void test_metrics_timer() {
+    metrics::histogram_t<> latency;
+    {
+        const metrics::scoped_timer timer(latency);
+        hpx::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    assert(latency.count() == 1);
+    assert(latency.min() >= 9000000);
+}
+} // end namespace
+
+// cppcheck-suppress constParameterReference
+auto hpx_main(hpx::program_options::variables_map& args) -> int { // NOLINT
+    test_metrics_histogram();
+    test_metrics_timer();
+    return hpx::finalize();
+}
+
+auto main(int argc, char *argv[]) -> int {
+    return hpx::init(argc, argv);
+}
@@ -0,0 +1,126 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright (C) 2025 David Sugar <tychosoft@gmail.com>
+
+#undef NDEBUG
+#include "system.hpp"
+#include "sketch.hpp"
+#include "binary.hpp"
+
+#include <string>
+#include <vector>
+
+using namespace hitycho;
+
+namespace {
+void test_sketch_bloom() {
+    sketch::bloom_t<int> filter(10000, 0.01);
+    assert(filter.bits() >= sketch::bloom_t<int>::bits_for(10000, 0.01));
+    assert(filter.hashes() == 7);
+    std::vector<hpx::future<void>> tasks;
+    for (auto worker = 0; worker < 4; ++worker) {
+        tasks.push_back(hpx::async([&filter, worker] {
+            for (auto key = worker; key < 10000; key += 4)
+                filter.insert(key);
+        }));
+    }
+    for (auto& task : tasks)
+        task.get();
+
+    std::size_t false_positives = 0;
+    for (auto key = 0; key < 10000; ++key) {
+        assert(filter.contains(key));
+        if (filter.contains(key + 1000000)) ++false_positives;
+    }
+    assert(false_positives < 300);
+
+    sketch::bloom_t<std::string> left(100), right(100);
+    assert(left.insert("one"));
+    assert(!left.insert("one"));
+    right.insert("two");
+    left |= right;
+    assert(left.contains("one") && left.contains("two"));
+
+    const auto words = left.save();
+    assert(words.size() * 64 == left.bits());
+    sketch::bloom_t<std::string> remote(100);
+    remote.insert("three");
+    remote.load(words);
+    assert(remote.contains("one") && remote.contains("two") && remote.contains("three"));
+    auto thrown = false;
+    try {
+        sketch::bloom_t<std::string> other(100000);
+        other.load(words);
+    } catch (const std::invalid_argument&) {
+        thrown = true;
+    }
+    assert(thrown);
+
+    left.clear();
+    assert(!left.contains("one"));
+}
+
+void test_sketch_hyperloglog() {
+    sketch::hyperloglog_t<int> left, right;
+    std::vector<hpx::future<void>> tasks;
+    for (auto worker = 0; worker < 4; ++worker) {
+        tasks.push_back(hpx::async([&left, worker] {
+            for (auto key = worker; key < 100000; key += 4)
+                left.insert(key);
+        }));
+    }
+    for (auto& task : tasks)
+        task.get();
+    for (auto key = 50000; key < 150000; ++key)
+        right.insert(key);
+
+    assert(left.size() > 95000 && left.size() < 105000);
+    left |= right;
+    assert(left.size() > 142500 && left.size() < 157500);
+
+    sketch::hyperloglog_t<byte_array> bytes;
+    bytes.insert(byte_array("abc", 3));
+    bytes.insert(byte_array("abc", 3));
+    bytes.insert(byte_array("xyz", 3));
+    assert(bytes.size() == 2);
+
+    auto task = hpx::async([] { // registers kept off small hpx stacks
+        const sketch::hyperloglog_t<int, 18> wide;
+        return wide.size();
+    });
+    assert(task.get() == 0);
+}
+
+void test_sketch_countmin() {
+    sketch::countmin_t<std::string> sketch;
+    for (auto count = 0; count < 10000; ++count)
+        sketch.insert(std::to_string(count));
+    assert(sketch.insert("talker", 500) >= 500);
+    assert(sketch.estimate("talker") >= 500);
+    assert(sketch.estimate("talker") < 520);
+    assert(sketch.estimate("1") >= 1);
+    assert(sketch.total() == 10500);
+
+    sketch::countmin_t<std::string> other;
+    other.insert("talker", 100);
+    sketch |= other;
+    assert(sketch.estimate("talker") >= 600);
+
+    auto task = hpx::async([] { // rows kept off small hpx stacks
+        sketch::countmin_t<int> local;
+        return local.insert(1);
+    });
+    assert(task.get() == 1);
+}
+} // end namespace
+
+// cppcheck-suppress constParameterReference
+auto hpx_main(hpx::program_options::variables_map& args) -> int { // NOLINT
+    test_sketch_bloom();
+    test_sketch_hyperloglog();
+    test_sketch_countmin();
+    return hpx::finalize();
+}
+
+auto main(int argc, char *argv[]) -> int {
+    return hpx::init(argc, argv);
+}
@@ -0,0 +1,119 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// Copyright (C) 2025 David Sugar <tychosoft@gmail.com>
+
+#undef NDEBUG
+#include "system.hpp"
+#include "stages.hpp"
+
+#include <algorithm>
+#include <vector>
+
+using namespace hitycho;
+
+namespace {
+auto counter(int limit) {
+    return [next = 0, limit]() mutable -> std::optional<int> {
+        if (next >= limit) return std::nullopt;
+        return ++next;
+    };
+}
+
+void test_stages_ordered() {
+    std::vector<int> out;
+    auto graph = system::flow_t<int>::source("count", counter(1000))
+                 .map("double", [](int value) { return value * 2; }, {4, true})
+                 .filter("thirds", [](const int& value) { return value % 3 != 0; }, {2, true})
+                 .flat_map("twice", [](int value) { return std::vector<int>{value, value}; }, {3, true})
+                 .sink("collect", [&out](int value) { out.push_back(value); });
+    graph.wait();
+
+    std::vector<int> expect;
+    for (auto value = 1; value <= 1000; ++value) {
+        if ((value * 2) % 3 == 0) continue;
+        expect.push_back(value * 2);
+        expect.push_back(value * 2);
+    }
+    assert(out == expect);
+
+    const auto stats = graph.stats();
+    assert(stats.size() == 5);
+    assert(stats[0].emitted == 1000 && stats[1].items == 1000);
+    assert(stats[4].items == expect.size());
+}
+
+void test_stages_unordered() {
+    std::atomic<long> total{0};
+    auto graph = system::flow_t<int, 8>::source("count", counter(500))
+                 .map("slow", [](int value) {
+                     hpx::this_thread::sleep_for(std::chrono::microseconds(200));
+                     return long(value);
+                 }, {2})
+                 .sink("sum", [&total](long value) { total += value; }, {2});
+    graph.wait();
+    assert(total == 500L * 501 / 2);
+    assert(graph.bottleneck() == "slow");
+}
+
+void test_stages_shared_source() {
+    std::vector<int> out;
+    auto graph = system::flow_t<int>::source("count", counter(1000), {4})
+                 .sink("collect", [&out](int value) { out.push_back(value); });
+    graph.wait();
+    std::sort(out.begin(), out.end());
+    assert(out.size() == 1000);
+    for (auto value = 1; value <= 1000; ++value)
+        assert(out[value - 1] == value);
+}
+
+void test_stages_moved() {
+    auto graph = system::flow_t<int>::source("count", counter(10))
+                 .sink("drop", [](int) {});
+    auto moved = std::move(graph);
+    graph.wait(); // NOLINT
+    graph.drain();
+    graph.close();
+    assert(graph.stats().empty() && graph.bottleneck().empty());
+    moved.wait();
+    assert(moved.stats().size() == 2);
+}
+
+void test_stages_failure() {
+    auto graph = system::flow_t<int>::source("count", counter(100))
+                 .map("fail", [](int value) {
+                     if (value == 50) throw std::runtime_error("bad item");
+                     return value;
+                 })
+                 .sink("drop", [](int) {});
+    auto thrown = false;
+    try {
+        graph.wait();
+    } catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    assert(thrown);
+}
+
+void test_stages_drain() {
+    std::atomic<int> seen{0};
+    auto graph = system::flow_t<int>::source("forever", [] { return std::optional<int>(1); })
+                 .sink("count", [&seen](int) { ++seen; });
+    hpx::this_thread::sleep_for(std::chrono::milliseconds(10));
+    graph.drain();
+    assert(seen > 0);
+}
+} // end namespace
+
+// cppcheck-suppress constParameterReference
+auto hpx_main(hpx::program_options::variables_map& args) -> int { // NOLINT
+    test_stages_ordered();
+    test_stages_unordered();
+    test_stages_shared_source();
+    test_stages_moved();
+    test_stages_failure();
+    test_stages_drain();
+    return hpx::finalize();
+}
+
+auto main(int argc, char *argv[]) -> int {
+    return hpx::init(argc, argv);
+}
@@ -5,6 +5,9 @@
 #include "system.hpp"
 #include "sync.hpp"
 #include "pipeline.hpp"
+#include "scan.hpp"
+
+#include <vector>
 
 using namespace hitycho;
 
@@ -46,6 +49,352 @@ void test_sync_semaphore() {
     sem.release();
 }
 
+void test_sync_pipeline() {
+    system::pipeline<int, 3> pipe;
+    for (auto count = 0; count < 7; ++count) {
+        pipe << count;
+        int item{-1};
+        pipe >> item;
+        assert(item == count);
+    }
+    pipe << 1 << 2 << 3;
+    assert(pipe.count() == 3);
+    assert(pipe.drop_if());
+    int item{0};
+    pipe >> item;
+    assert(item == 2);
+    pipe.close();
+    assert(!pipe.is_open());
+}
+
+void test_sync_pipeline_batch() {
+    system::pipeline<int, 8> pipe;
+    const std::vector<int> items{1, 2, 3, 4, 5};
+    assert(pipe.push_range(items.begin(), items.end()) == 5);
+    assert(pipe.push_n(items.begin(), 2) == 2);
+    assert(pipe.count() == 7);
+
+    std::vector<int> out;
+    assert(pipe.pull_n(std::back_inserter(out), 4) == 4);
+    assert((out == std::vector<int>{1, 2, 3, 4}));
+    auto sum = 0;
+    assert(pipe.drain([&sum](int item) { sum += item; }) == 3);
+    assert(sum == 5 + 1 + 2);
+    assert(pipe.empty());
+
+    auto producer = hpx::async([&pipe] {
+        std::vector<int> many(20, 1);
+        return pipe.push_range(many.begin(), many.end());
+    });
+    std::size_t total = 0;
+    while (total < 20) {
+        out.clear();
+        total += pipe.pull_n(std::back_inserter(out), 8, 4, std::chrono::milliseconds(10));
+    }
+    assert(producer.get() == 20);
+}
+
+void test_sync_pipeline_wakeup() {
+    system::pipeline<int, 8> pipe;
+    std::vector<hpx::future<int>> consumers;
+    for (auto worker = 0; worker < 2; ++worker) {
+        consumers.push_back(hpx::async([&pipe] {
+            int item{0};
+            pipe >> item;
+            return item;
+        }));
+    }
+    hpx::this_thread::sleep_for(std::chrono::milliseconds(20));
+    pipe << 1 << 2; // only the first push signals
+    assert(consumers[0].get() + consumers[1].get() == 3);
+}
+
+void test_sync_pipeline_timed() {
+    system::pipeline<int, 2> pipe;
+    int item{-1};
+    assert(!pipe.pull_for(item, std::chrono::milliseconds(10)));
+    assert(pipe.is_open());
+    assert(pipe.push_for(1, std::chrono::milliseconds(10)));
+    assert(pipe.push_for(2, std::chrono::milliseconds(10)));
+    assert(!pipe.push_for(3, std::chrono::milliseconds(10)));
+    assert(pipe.pull_until(item, std::chrono::steady_clock::now() + std::chrono::milliseconds(10)));
+    assert(item == 1);
+
+    auto ready = pipe.async_pull();
+    assert(ready.get() == 2);
+    auto pending = pipe.async_pull();
+    pipe << 5;
+    assert(pending.get() == 5);
+    assert(pipe.empty());
+
+    pipe << 6 << 7;
+    auto pushed = pipe.async_push(8);
+    assert(pipe.count() == 2);
+    pipe >> item;
+    assert(item == 6 && pushed.get());
+    pipe >> item;
+    assert(item == 7);
+    pipe >> item;
+    assert(item == 8);
+
+    pipe << 1 << 2;
+    auto blocked = pipe.async_push(3);
+    auto waiting = system::pipeline<int, 2>{}.async_pull(); // closed on exit
+    pipe.close();
+    assert(!blocked.get());
+    auto thrown = false;
+    try {
+        waiting.get();
+    } catch (const invalid&) {
+        thrown = true;
+    }
+    assert(thrown);
+
+    system::drop_pipeline<int, 2> dropping;
+    dropping << 1 << 2;
+    auto dropped = dropping.async_push(3);
+    assert(dropped.get()); // ready, the oldest was dropped
+    dropping >> item;
+    assert(item == 2);
+
+    system::throw_pipeline<int, 1> throwing;
+    throwing << 1;
+    auto failed = throwing.async_push(2);
+    thrown = false;
+    try {
+        failed.get();
+    } catch (const invalid&) {
+        thrown = true;
+    }
+    assert(thrown);
+}
+
+void test_sync_runtime_pipeline() {
+    system::pipeline<int, system::runtime_size> pipe(parse_size("4k"), {true, system::numa_node()});
+    assert(pipe.capacity() == 4096);
+    assert(!pipe.huge_pages()); // too small to round up to a huge page
+    const system::pipeline<char, system::runtime_size> large(std::size_t(2) << 20, {true});
+    assert(large.huge_pages());
+    std::vector<int> items(pipe.capacity());
+    for (auto pos = 0U; pos < items.size(); ++pos)
+        items[pos] = int(pos);
+    assert(pipe.push_range(items.begin(), items.begin() + 100) == 100);
+    std::vector<int> out;
+    assert(pipe.pull_n(std::back_inserter(out), 100) == 100);
+    assert(pipe.push_range(items.begin(), items.end()) == 4096); // wraps
+    assert(pipe.count() == 4096);
+    assert(pipe.drop_if());
+    int item{-1};
+    pipe >> item;
+    assert(item == 1);
+
+    system::drop_pipeline<int, system::runtime_size> dropping(2);
+    dropping << 1 << 2 << 3;
+    dropping >> item;
+    assert(item == 2);
+
+    auto thrown = false;
+    try {
+        const system::pipeline<int, system::runtime_size> empty(0);
+    } catch (const range&) {
+        thrown = true;
+    }
+    assert(thrown);
+}
+
+void test_sync_priority_pipeline() {
+    system::priority_pipeline<int, 8> pipe;
+    pipe << 1 << 2;
+    pipe.push(9, 0);
+    assert(pipe.count() == 3 && pipe.count(0) == 1);
+    std::size_t lane{1};
+    int item{-1};
+    assert(pipe.pull(item, lane));
+    assert(item == 9 && lane == 0);
+    pipe >> item;
+    assert(item == 1);
+
+    system::drop_priority_pipeline<int, 4> dropping;
+    dropping << 1 << 2 << 3 << 4;
+    assert(dropping.push(100, 0));
+    assert(dropping.count() == 4 && dropping.count(1) == 3);
+    dropping >> item;
+    assert(item == 100);
+    dropping >> item;
+    assert(item == 2);
+    dropping.clear();
+    for (auto count = 0; count < 4; ++count)
+        dropping.push(count, 0);
+    assert(dropping.push(5, 1)); // dropped, nothing less urgent
+    assert(dropping.count(1) == 0);
+
+    system::priority_pipeline<int, 16> weighted({2, 1});
+    for (auto count = 0; count < 4; ++count)
+        weighted.push(10 + count, 0);
+    for (auto count = 0; count < 3; ++count)
+        weighted.push(20 + count, 1);
+    std::vector<std::size_t> lanes;
+    while (!weighted.empty()) {
+        weighted.pull(item, lane);
+        lanes.push_back(lane);
+    }
+    assert((lanes == std::vector<std::size_t>{0, 0, 1, 0, 0, 1, 1}));
+
+    auto thrown = false;
+    try {
+        pipe.push(1, 2);
+    } catch (const range&) {
+        thrown = true;
+    }
+    assert(thrown);
+}
+
+void test_sync_sharded_pipeline() {
+    using item_t = std::pair<int, int>; // key, sequence
+    const auto key_of = [](const item_t& item) { return item.first; };
+    system::sharded_pipeline<item_t, 32, 4, decltype(key_of)> pipe(key_of, {}, true);
+    assert(pipe.shards() == 4 && pipe.capacity() == 128);
+
+    int keys[24]{};
+    const auto owner = pipe.shard_of({0, 0});
+    for (auto key = 0, found = 0; found < 24; ++key) {
+        if (pipe.shard_of({key, 0}) == owner) keys[found++] = key;
+    }
+    for (auto key : keys)
+        pipe << item_t{key, 0};
+    assert(pipe.count(owner) == 24);
+    item_t item{};
+    assert(pipe.pull(owner, item));
+    const auto thief = (owner + 1) % 4;
+    assert(pipe.try_pull(thief, item)); // steals a waiting key
+    assert(pipe.shard_of(item) == thief);
+    assert(pipe.count() == 22);
+    std::size_t drained = pipe.drain([](item_t&&) {});
+    assert(drained == 22 && pipe.empty());
+    pipe.done(owner);
+    pipe.done(thief);
+
+    {
+        system::sharded_pipeline<item_t, 32, 4, decltype(key_of)> idle(key_of, {}, true);
+        std::atomic<int> stolen{-1};
+        const hpx::jthread waiting([&] { // blocks until a shard offers work
+            item_t next{};
+            if (idle.pull(thief, next)) stolen = next.first;
+        });
+        hpx::this_thread::sleep_for(std::chrono::milliseconds(20));
+        for (auto key : keys)
+            idle << item_t{key, 0};
+        while (stolen < 0)
+            hpx::this_thread::yield();
+        assert(idle.shard_of({stolen, 0}) == thief);
+        idle.close();
+    }
+
+    struct session_t {
+        int id{0};
+    };
+    system::sharded_pipeline<session_t, 4, 2, int session_t::*> members(&session_t::id);
+    members << session_t{5};
+    session_t member{};
+    assert(members.pull(members.shard_of(session_t{5}), member) && member.id == 5);
+
+    constexpr int total = 8 * 200;
+    std::atomic<int> seen{0};
+    int last[8]{};
+    for (auto& value : last)
+        value = -1;
+    {
+        std::vector<hpx::jthread> consumers;
+        for (std::size_t shard = 0; shard < pipe.shards(); ++shard) {
+            consumers.emplace_back([&, shard] {
+                item_t next{};
+                while (pipe.pull(shard, next)) {
+                    assert(last[next.first] == next.second - 1); // key order kept
+                    last[next.first] = next.second;
+                    ++seen;
+                }
+            });
+        }
+        for (auto seq = 0; seq < 200; ++seq) {
+            for (auto key = 0; key < 8; ++key)
+                pipe << item_t{key, seq};
+        }
+        while (seen < total)
+            hpx::this_thread::yield();
+        pipe.close();
+    }
+    assert(!pipe.is_open());
+}
+
+void test_sync_lockfree_pipeline() {
+    system::lockfree_pipeline<int, 8> pipe;
+    std::atomic<long> total{0};
+    std::vector<hpx::future<void>> consumers;
+    for (auto worker = 0; worker < 4; ++worker) {
+        consumers.push_back(hpx::async([&pipe, &total] {
+            int item{0};
+            for (auto count = 0; count < 250; ++count) {
+                pipe >> item;
+                total += item;
+            }
+        }));
+    }
+
+    std::vector<hpx::future<void>> producers;
+    for (auto worker = 0; worker < 4; ++worker) {
+        producers.push_back(hpx::async([&pipe] {
+            for (auto count = 1; count <= 250; ++count)
+                pipe << count;
+        }));
+    }
+    for (auto& task : producers)
+        task.get();
+    for (auto& task : consumers)
+        task.get();
+    assert(total == 4 * 125 * 251);
+    assert(pipe.empty());
+
+    system::drop_pipeline<int, 2, system::lockfree_pipeline> dropping;
+    dropping << 1 << 2 << 3;
+    int item{0};
+    dropping >> item;
+    assert(item == 2);
+
+    system::notify_pipeline<int, 8, system::lockfree_pipeline> notify;
+    assert(!notify.wait(0));
+    notify << 1;
+    assert(notify.wait(0));
+    notify >> item;
+    assert(!notify.wait(0));
+    for (auto round = 0; round < 100; ++round) { // racing transitions
+        auto consumer = hpx::async([&notify] {
+            int value{0};
+            for (auto count = 0; count < 50;) {
+                if (notify.try_pull(value)) ++count;
+            }
+        });
+        for (auto count = 0; count < 50; ++count)
+            notify.push(count);
+        consumer.get();
+        assert(!notify.wait(0));
+        notify << 1;
+        assert(notify.wait(0));
+        notify >> item;
+    }
+
+    system::throw_pipeline<int, 2, system::lockfree_pipeline> throwing;
+    throwing << 1 << 2;
+    auto thrown = false;
+    try {
+        throwing << 3;
+    } catch (const std::exception&) {
+        thrown = true;
+    }
+    assert(thrown);
+    throwing.close();
+    assert(!throwing.try_pull(item));
+}
+
 void test_sync_waitgroup() {
     sync::wait_group wg(1);
     {
@@ -62,6 +411,14 @@ auto hpx_main(hpx::program_options::variables_map& args) -> int { // NOLINT
     test_sync_barrier();
     test_sync_semaphore();
     test_sync_waitgroup();
+    test_sync_pipeline();
+    test_sync_pipeline_batch();
+    test_sync_pipeline_wakeup();
+    test_sync_pipeline_timed();
+    test_sync_runtime_pipeline();
+    test_sync_priority_pipeline();
+    test_sync_sharded_pipeline();
+    test_sync_lockfree_pipeline();
     return hpx::finalize();
 }
 